@@ -33,10 +33,22 @@ namespace stackdb {
         // Env interfaces
         virtual Status new_sequential_file(const std::string& fname, SequentialFile** result) = 0;      // result can be accessed at one time
         virtual Status new_random_access_file(const std::string& fname, RandomAccessFile** result) = 0; // result can be accessed concurrently
+        // like new_sequential_file(), but reads may return slices into a memory mapping of the file
+        // rather than copies in scratch, valid as long as the file. for one pass over a large file
+        virtual Status new_mmap_sequential_file(const std::string& fname, SequentialFile** result) {
+            return new_sequential_file(fname, result);
+        }
         virtual Status new_writable_file(const std::string& fname, WritableFile** result) = 0;          // one time
         virtual Status new_appendable_file(const std::string& fname, WritableFile** result) {           // one time
             return Status::NotSupported("new_appendable_file", fname);                                  // not supported by default
         }
+        // rename old_fname to fname and open it for writing from the start. unlike new_writable_file(),
+        // the old contents and space are kept, so writes there don't allocate. for recycling log files.
+        // not supported by default, so callers create a new file instead
+        virtual Status reuse_writable_file(const std::string& fname, const std::string& old_fname, WritableFile** result) {
+            *result = nullptr;
+            return Status::NotSupported("reuse_writable_file", fname);
+        }
         virtual bool file_exists(const std::string &fname) = 0;                                         // return true if fname exists
         virtual Status get_children(const std::string &dirname, std::vector<std::string> *result) = 0;      // store filenames under dir in *result
         virtual Status remove_file(const std::string &fname) = 0;                                       // delete file. no delete_file as in leveldb
@@ -92,6 +104,12 @@ namespace stackdb {
         virtual Status close() = 0;                     // close flushes internal buf, and closes fd
         virtual Status flush() = 0;                     // flush flushes internal buf
         virtual Status sync() = 0;                      // sync flushes buf and underlying system buf
+        // sync what was flushed, leaving the internal buf alone, so it may run while another thread
+        // appends and flushes. not supported by default
+        virtual Status sync_data() { return Status::NotSupported("sync_data"); }
+        // reserve space for [offset, offset + length) without changing the file size, so later
+        // appends there don't grow the file's allocation. no-op by default
+        virtual Status preallocate(uint64_t offset, uint64_t length) { return Status::OK(); }
     };  
 
     // an interface for writing log messages.
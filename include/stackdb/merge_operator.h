@@ -0,0 +1,37 @@
+#ifndef STACKDB_MERGE_OPERATOR_H
+#define STACKDB_MERGE_OPERATOR_H
+
+#include <string>
+#include <vector>
+
+// A MergeOperator lets a write carry an operand, e.g. "+1", that is combined with the current
+// value of its key when read, instead of the writer doing a read-modify-write.
+
+namespace stackdb {
+    class Slice;    // forward declaration
+
+    class MergeOperator {
+    public:
+        virtual ~MergeOperator();
+        // name of the merge operator. "stackdb.*" are reserved
+        virtual const char *name() const = 0;
+        // apply operands, oldest first, to existing_value into *new_value. existing_value is null if
+        // the key has no value, or was deleted. return false if the inputs are corrupt
+        virtual bool full_merge(const Slice &key, const Slice *existing_value,
+                                const std::vector<Slice> &operands, std::string *new_value) const = 0;
+        // combine two adjacent operands, left older than right, into one operand *new_value that
+        // has the same effect. return false if they can't be combined, so both are kept
+        virtual bool partial_merge(const Slice &key, const Slice &left, const Slice &right,
+                                   std::string *new_value) const {
+            return false;
+        }
+    };
+
+    // return a builtin merge operator for counters. values and operands are fixed 64 bit
+    // little-endian integers, and merging adds them
+    const MergeOperator *new_uint64_add_merge_operator();
+    // return a builtin merge operator that appends operands to the value, separated by delimiter
+    const MergeOperator *new_string_append_merge_operator(char delimiter = ',');
+} // namespace stackdb
+
+#endif
@@ -0,0 +1,520 @@
+#include <cstring>
+#include <mutex>
+#include "db/memtable_rep.h"
+#include "stackdb/comparator.h"
+#include "util/coding.h"
+
+namespace stackdb {
+namespace {
+    // byte-ordered form of an entry's internal key, so ordering the tree by bytes matches
+    // InternalKeyComparator over bytewise user keys. the user key has each 0x00 escaped as
+    // 0x00 0xff and ends with 0x00 0x00, followed by the inverted tag in big-endian so newer
+    // sequence numbers come first. no encoded key is a prefix of another
+    size_t tree_key_size(const char *entry) {
+        Slice user_key = extract_user_key(get_length_prefixed_slice(entry));
+        size_t size = user_key.size() + 2 + 8;
+        for (size_t i = 0; i < user_key.size(); i ++) {
+            if (user_key[i] == '\0') size ++;
+        }
+        return size;
+    }
+    // dst must hold tree_key_size(entry) bytes
+    void encode_tree_key(const char *entry, char *dst) {
+        Slice internal_key = get_length_prefixed_slice(entry);
+        Slice user_key = extract_user_key(internal_key);
+        uint64_t tag = ~decode_fixed_64(internal_key.data() + user_key.size());
+
+        for (size_t i = 0; i < user_key.size(); i ++) {
+            *dst++ = user_key[i];
+            if (user_key[i] == '\0') *dst++ = '\xff';
+        }
+        *dst++ = '\0';
+        *dst++ = '\0';
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            *dst++ = static_cast<char>(tag >> shift);
+        }
+    }
+    void encode_tree_key(const char *entry, std::string *dst) {
+        dst->resize(tree_key_size(entry));
+        encode_tree_key(entry, &(*dst)[0]);
+    }
+
+    // adaptive radix tree over encoded keys. entries hang off leaves, and inner nodes branch
+    // on one byte of the key at their depth. path compression is implicit: bytes between a
+    // node's parent and its depth are shared by the whole subtree, so they are read from
+    // the key of any leaf below it.
+    //
+    // like SkipList, readers need no lock while a writer inserts. a node is only changed in
+    // place by publishing a new child, and is otherwise replaced by a copy stored into its
+    // parent's slot with a release store. replaced nodes stay readable in the arena
+    class ArtRep: public MemTableRep {
+    public:
+        ArtRep(Arena *arena): arena(arena), root(nullptr) {}
+
+        void insert(const char *entry) override { insert_leaf(entry, false); }
+        // writers are serialized by a mutex. readers still go lock-free
+        void insert_concurrently(const char *entry) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            insert_leaf(entry, true);
+        }
+
+        // descends straight to the first version of the user key at or after key, then walks the
+        // versions below the node where they branch off. no allocation unless the key is long
+        void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) override {
+            char space[200];
+            std::unique_ptr<char[]> heap;
+            const uint32_t size = tree_key_size(key);
+            char *buf = space;
+            if (size > sizeof(space)) {
+                heap.reset(new char[size]);
+                buf = heap.get();
+            }
+            encode_tree_key(key, buf);
+            const uint8_t *k = reinterpret_cast<const uint8_t *>(buf);
+            const uint32_t tag_start = size - 8;    // key bytes from here are the tag
+
+            // nodes branching on tag bytes on the path, all under the user key's versions
+            Frame frames[8];
+            int top = 0;
+            const Leaf *leaf = nullptr;
+            Node *n = root.load(std::memory_order_acquire);
+            uint32_t depth = 0;
+            while (n != nullptr) {
+                const uint8_t *nk = reinterpret_cast<const uint8_t *>(n->key);
+                uint32_t end = is_leaf(n) ? as_leaf(n)->key_size : n->depth;
+                uint32_t i = depth;
+                while (i < end && i < size && nk[i] == k[i]) i ++;
+                if (i < end && (i == size || nk[i] > k[i])) {
+                    if (i < tag_start) return;  // the subtree is after the user key
+                    leaf = first_leaf(n, frames, &top);
+                    break;
+                }
+                if (i < end || is_leaf(n)) {
+                    // equal, or the subtree is before key
+                    leaf = (is_leaf(n) && i == size) ? as_leaf(n) : next_leaf(frames, &top);
+                    break;
+                }
+                int b;
+                Node *child = child_near(n, k[end], true, &b);
+                if (child == nullptr) {
+                    leaf = next_leaf(frames, &top);
+                    break;
+                }
+                if (end >= tag_start) {
+                    assert(top < 8);
+                    frames[top ++] = {n, b};
+                }
+                if (b != k[end]) {
+                    if (end < tag_start) return;
+                    leaf = first_leaf(child, frames, &top);
+                    break;
+                }
+                n = child;
+                depth = end + 1;
+            }
+            while (leaf != nullptr && callback(arg, leaf->entry)) {
+                leaf = next_leaf(frames, &top);
+            }
+        }
+        MemTableRep::Iterator *new_iterator() override { return new Iterator(this); }
+        // leaves hold encoded keys, with the tag
+        bool supports_inplace_update() const override { return false; }
+
+    private:
+        enum class NodeType : uint8_t { LEAF, NODE4, NODE16, NODE48, NODE256 };
+
+        struct Node {
+            NodeType type;
+            std::atomic<uint16_t> count;    // num of children. inner nodes only
+            uint32_t depth;                 // index of the key byte this node branches on
+            const char *key;                // encoded key of some leaf below, for the compressed path
+        };
+        struct Leaf: Node {
+            const char *entry;
+            uint32_t key_size;
+        };
+        // unsorted, since children are appended in place
+        template <int CAP>
+        struct SmallNode: Node {
+            static const int capacity = CAP;
+            uint8_t bytes[CAP];
+            std::atomic<Node *> children[CAP];
+        };
+        typedef SmallNode<4> Node4;
+        typedef SmallNode<16> Node16;
+        struct Node48: Node {
+            static const int capacity = 48;
+            std::atomic<uint8_t> index[256];    // slot + 1 in children, 0 if none
+            std::atomic<Node *> children[48];
+        };
+        struct Node256: Node {
+            std::atomic<Node *> children[256];
+        };
+
+        struct Frame {
+            const Node *node;
+            int byte;   // byte of the child on the path
+        };
+
+        static bool is_leaf(const Node *n) { return n->type == NodeType::LEAF; }
+        static const Leaf *as_leaf(const Node *n) { return static_cast<const Leaf *>(n); }
+
+        // slot of child for byte b, or null
+        static std::atomic<Node *> *child_slot(Node *n, uint8_t b) {
+            switch (n->type) {
+            case NodeType::NODE4:   return small_child_slot(static_cast<Node4 *>(n), b);
+            case NodeType::NODE16:  return small_child_slot(static_cast<Node16 *>(n), b);
+            case NodeType::NODE48: {
+                Node48 *n48 = static_cast<Node48 *>(n);
+                uint8_t slot = n48->index[b].load(std::memory_order_acquire);
+                return slot == 0 ? nullptr : &n48->children[slot - 1];
+            }
+            case NodeType::NODE256: {
+                Node256 *n256 = static_cast<Node256 *>(n);
+                return n256->children[b].load(std::memory_order_acquire) == nullptr ? nullptr
+                                                                                    : &n256->children[b];
+            }
+            default:
+                assert(false);
+                return nullptr;
+            }
+        }
+        template <typename T>
+        static std::atomic<Node *> *small_child_slot(T *n, uint8_t b) {
+            int count = n->count.load(std::memory_order_acquire);
+            for (int i = 0; i < count; i ++) {
+                if (n->bytes[i] == b) return &n->children[i];
+            }
+            return nullptr;
+        }
+
+        // child with the smallest byte >= b (forward) or largest byte <= b (backward).
+        // its byte is stored in *found. null if none
+        static Node *child_near(const Node *n, int b, bool forward, int *found) {
+            switch (n->type) {
+            case NodeType::NODE4:   return small_child_near(static_cast<const Node4 *>(n), b, forward, found);
+            case NodeType::NODE16:  return small_child_near(static_cast<const Node16 *>(n), b, forward, found);
+            case NodeType::NODE48: {
+                const Node48 *n48 = static_cast<const Node48 *>(n);
+                for (; b >= 0 && b < 256; b += forward ? 1 : -1) {
+                    uint8_t slot = n48->index[b].load(std::memory_order_acquire);
+                    if (slot != 0) {
+                        *found = b;
+                        return n48->children[slot - 1].load(std::memory_order_acquire);
+                    }
+                }
+                return nullptr;
+            }
+            case NodeType::NODE256: {
+                const Node256 *n256 = static_cast<const Node256 *>(n);
+                for (; b >= 0 && b < 256; b += forward ? 1 : -1) {
+                    Node *child = n256->children[b].load(std::memory_order_acquire);
+                    if (child != nullptr) {
+                        *found = b;
+                        return child;
+                    }
+                }
+                return nullptr;
+            }
+            default:
+                assert(false);
+                return nullptr;
+            }
+        }
+        template <typename T>
+        static Node *small_child_near(const T *n, int b, bool forward, int *found) {
+            int count = n->count.load(std::memory_order_acquire);
+            int best = -1;
+            for (int i = 0; i < count; i ++) {
+                int byte = n->bytes[i];
+                if ((forward ? byte >= b : byte <= b) &&
+                    (best < 0 || (forward ? byte < n->bytes[best] : byte > n->bytes[best]))) {
+                    best = i;
+                }
+            }
+            if (best < 0) return nullptr;
+            *found = n->bytes[best];
+            return n->children[best].load(std::memory_order_acquire);
+        }
+
+        template <typename T>
+        T *new_node(NodeType type, uint32_t depth, const char *key, bool concurrent, size_t extra = 0) {
+            char *mem = concurrent ? arena->allocate_aligned_concurrently(sizeof(T) + extra)
+                                   : arena->allocate_aligned(sizeof(T) + extra);
+            T *n = new (mem) T();   // value-initialized, so children start null
+            n->type = type;
+            n->depth = depth;
+            n->key = key;
+            return n;
+        }
+
+        // append child for byte b to n in place. n must not be full
+        static void add_child(Node *n, uint8_t b, Node *child) {
+            switch (n->type) {
+            case NodeType::NODE4:   add_small_child(static_cast<Node4 *>(n), b, child); break;
+            case NodeType::NODE16:  add_small_child(static_cast<Node16 *>(n), b, child); break;
+            case NodeType::NODE48: {
+                Node48 *n48 = static_cast<Node48 *>(n);
+                uint16_t count = n48->count.load(std::memory_order_relaxed);
+                n48->children[count].store(child, std::memory_order_relaxed);
+                n48->index[b].store(count + 1, std::memory_order_release);
+                n48->count.store(count + 1, std::memory_order_relaxed);
+                break;
+            }
+            case NodeType::NODE256:
+                static_cast<Node256 *>(n)->children[b].store(child, std::memory_order_release);
+                n->count.fetch_add(1, std::memory_order_relaxed);
+                break;
+            default:
+                assert(false);
+            }
+        }
+        template <typename T>
+        static void add_small_child(T *n, uint8_t b, Node *child) {
+            uint16_t count = n->count.load(std::memory_order_relaxed);
+            n->bytes[count] = b;
+            n->children[count].store(child, std::memory_order_relaxed);
+            n->count.store(count + 1, std::memory_order_release);
+        }
+
+        static bool is_full(const Node *n) {
+            uint16_t count = n->count.load(std::memory_order_relaxed);
+            switch (n->type) {
+            case NodeType::NODE4:   return count == Node4::capacity;
+            case NodeType::NODE16:  return count == Node16::capacity;
+            case NodeType::NODE48:  return count == Node48::capacity;
+            default:                return false;
+            }
+        }
+
+        // copy of full node n with room for one more child
+        Node *grow(Node *n, bool concurrent) {
+            int b = 0;
+            Node *grown;
+            switch (n->type) {
+            case NodeType::NODE4:   grown = new_node<Node16>(NodeType::NODE16, n->depth, n->key, concurrent); break;
+            case NodeType::NODE16:  grown = new_node<Node48>(NodeType::NODE48, n->depth, n->key, concurrent); break;
+            default:                grown = new_node<Node256>(NodeType::NODE256, n->depth, n->key, concurrent); break;
+            }
+            for (Node *child = child_near(n, 0, true, &b); child != nullptr; child = child_near(n, b + 1, true, &b)) {
+                add_child(grown, b, child);
+                if (b == 255) break;
+            }
+            return grown;
+        }
+
+        void insert_leaf(const char *entry, bool concurrent) {
+            std::string key;
+            encode_tree_key(entry, &key);
+            Leaf *leaf = new_node<Leaf>(NodeType::LEAF, 0, nullptr, concurrent, key.size());
+            char *key_copy = reinterpret_cast<char *>(leaf + 1);
+            std::memcpy(key_copy, key.data(), key.size());
+            leaf->key = key_copy;
+            leaf->entry = entry;
+            leaf->key_size = key.size();
+
+            const uint8_t *k = reinterpret_cast<const uint8_t *>(key_copy);
+            std::atomic<Node *> *ref = &root;
+            uint32_t depth = 0;
+            while (true) {
+                Node *n = ref->load(std::memory_order_relaxed);
+                if (n == nullptr) {
+                    ref->store(leaf, std::memory_order_release);
+                    return;
+                }
+                // find where key leaves the path to n. keys are prefix free, so it must
+                // diverge from a leaf before either ends
+                const uint8_t *nk = reinterpret_cast<const uint8_t *>(n->key);
+                uint32_t end = is_leaf(n) ? as_leaf(n)->key_size : n->depth;
+                uint32_t i = depth;
+                while (i < end && i < leaf->key_size && nk[i] == k[i]) i ++;
+                assert(i < leaf->key_size);
+                if (i < end) {
+                    // split the path with a new node branching at i
+                    Node4 *split = new_node<Node4>(NodeType::NODE4, i, key_copy, concurrent);
+                    add_child(split, nk[i], n);
+                    add_child(split, k[i], leaf);
+                    ref->store(split, std::memory_order_release);
+                    return;
+                }
+                assert(!is_leaf(n));    // else keys were equal
+
+                std::atomic<Node *> *slot = child_slot(n, k[n->depth]);
+                if (slot != nullptr) {
+                    ref = slot;
+                    depth = n->depth + 1;
+                    continue;
+                }
+                if (is_full(n)) {
+                    n = grow(n, concurrent);
+                    add_child(n, k[n->depth], leaf);
+                    ref->store(n, std::memory_order_release);
+                } else {
+                    add_child(n, k[n->depth], leaf);
+                }
+                return;
+            }
+        }
+
+        // first leaf under n, pushing the inner nodes on the way to frames
+        static const Leaf *first_leaf(const Node *n, Frame *frames, int *top) {
+            while (!is_leaf(n)) {
+                int b;
+                const Node *child = child_near(n, 0, true, &b);
+                assert(*top < 8);
+                frames[(*top) ++] = {n, b};
+                n = child;
+            }
+            return as_leaf(n);
+        }
+        // leaf after the subtree at the top of frames, or null once frames run out
+        static const Leaf *next_leaf(Frame *frames, int *top) {
+            while (*top > 0) {
+                Frame &frame = frames[*top - 1];
+                int b;
+                const Node *child = frame.byte < 255 ? child_near(frame.node, frame.byte + 1, true, &b) : nullptr;
+                if (child != nullptr) {
+                    frame.byte = b;
+                    return first_leaf(child, frames, top);
+                }
+                (*top) --;
+            }
+            return nullptr;
+        }
+
+        // walks the tree with a stack of the inner nodes above the current leaf
+        class Iterator: public MemTableRep::Iterator {
+        public:
+            explicit Iterator(const ArtRep *rep): rep(rep), leaf(nullptr) {}
+
+            bool valid() const override { return leaf != nullptr; }
+            const char *key() const override {
+                assert(valid());
+                return leaf->entry;
+            }
+            void next() override {
+                assert(valid());
+                step(true);
+            }
+            void prev() override {
+                assert(valid());
+                step(false);
+            }
+            void seek_to_first() override { reset_to_edge(true); }
+            void seek_to_last() override { reset_to_edge(false); }
+
+            // position at the first leaf with encoded key >= target's
+            void seek(const char *target) override {
+                encode_tree_key(target, &spirit);
+                const uint8_t *k = reinterpret_cast<const uint8_t *>(spirit.data());
+                uint32_t size = spirit.size();
+
+                stack.clear();
+                leaf = nullptr;
+                Node *n = rep->root.load(std::memory_order_acquire);
+                uint32_t depth = 0;
+                while (n != nullptr) {
+                    // compare the path to n, or the whole key at a leaf
+                    const uint8_t *nk = reinterpret_cast<const uint8_t *>(n->key);
+                    uint32_t end = is_leaf(n) ? as_leaf(n)->key_size : n->depth;
+                    uint32_t i = depth;
+                    while (i < end && i < size && nk[i] == k[i]) i ++;
+                    if (i < end && (i == size || nk[i] > k[i])) {
+                        descend(n, true);       // the whole subtree is after target
+                        return;
+                    }
+                    if (i < end || is_leaf(n)) {
+                        if (is_leaf(n) && i == size) {
+                            leaf = as_leaf(n);  // equal
+                            return;
+                        }
+                        step(true);             // the whole subtree is before target
+                        return;
+                    }
+                    if (end == size) {          // target ends at n. can't happen with prefix free keys
+                        descend(n, true);
+                        return;
+                    }
+                    int b;
+                    Node *child = child_near(n, k[end], true, &b);
+                    if (child == nullptr) {
+                        step(true);
+                        return;
+                    }
+                    stack.push_back({n, b});
+                    if (b != k[end]) {
+                        descend(child, true);
+                        return;
+                    }
+                    n = child;
+                    depth = end + 1;
+                }
+            }
+
+        private:
+            void reset_to_edge(bool first) {
+                stack.clear();
+                leaf = nullptr;
+                Node *n = rep->root.load(std::memory_order_acquire);
+                if (n != nullptr) descend(n, first);
+            }
+            // go down to the first (or last) leaf under n
+            void descend(const Node *n, bool first) {
+                while (!is_leaf(n)) {
+                    int b;
+                    const Node *child = child_near(n, first ? 0 : 255, first, &b);
+                    assert(child != nullptr);   // inner nodes are never empty
+                    stack.push_back({n, b});
+                    n = child;
+                }
+                leaf = as_leaf(n);
+            }
+            // move to the next (or previous) leaf past the subtree at the top of the stack
+            void step(bool forward) {
+                leaf = nullptr;
+                while (!stack.empty()) {
+                    Frame &frame = stack.back();
+                    int from = frame.byte + (forward ? 1 : -1);
+                    int b;
+                    const Node *child = (from >= 0 && from < 256) ? child_near(frame.node, from, forward, &b) : nullptr;
+                    if (child != nullptr) {
+                        frame.byte = b;
+                        descend(child, forward);
+                        return;
+                    }
+                    stack.pop_back();
+                }
+            }
+
+            const ArtRep *const rep;
+            const Leaf *leaf;           // null if not valid
+            std::vector<Frame> stack;
+            std::string spirit;         // encoded seek target
+        };
+
+        Arena *const arena;
+        std::atomic<Node *> root;
+        std::mutex mutex;               // for insert_concurrently()
+    };
+
+    class ArtRepFactory: public MemTableRepFactory {
+    public:
+        ArtRepFactory(): fallback(new_skiplist_rep_factory()) {}
+        const char *name() const override { return "stackdb.ArtRep"; }
+        // the tree orders keys by their bytes. other user comparators get a skiplist
+        MemTableRep *create(const MemTableKeyComparator &cmp, Arena *arena) const override {
+            if (cmp.comparator.user_comparator() != bytewise_comparator()) {
+                return fallback->create(cmp, arena);
+            }
+            return new ArtRep(arena);
+        }
+    private:
+        const std::unique_ptr<MemTableRepFactory> fallback;
+    };
+} // anonymous namespace
+
+MemTableRepFactory *new_art_rep_factory() {
+    return new ArtRepFactory();
+}
+
+} // namespace stackdb
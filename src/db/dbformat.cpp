@@ -58,17 +58,7 @@ const char *InternalKeyComparator::name() const {
 //    decreasing sequence number
 //    decreasing type (though sequence# should be enough to disambiguate)
 int InternalKeyComparator::compare(const Slice& a_key, const Slice& b_key) const {
-    int res = user_cmp->compare(extract_user_key(a_key), extract_user_key(b_key));
-    if (res == 0) {
-        uint64_t a_seq_type = decode_fixed_64(a_key.data() + a_key.size() - 8);
-        uint64_t b_seq_type = decode_fixed_64(b_key.data() + b_key.size() - 8);
-        if (a_seq_type > b_seq_type) {          // a_key is newer, thus a is smaller
-            return -1;
-        } else if (a_seq_type < b_seq_type) {   // b_key is newer, thus a is bigger
-            return +1;
-        }
-    }
-    return res;
+    return compare_internal_keys(*user_cmp, a_key, b_key);
 }
 void InternalKeyComparator::find_shortest_separator(std::string *start, const Slice &limit) const {
     Slice user_start = extract_user_key(*start);
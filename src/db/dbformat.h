@@ -4,6 +4,7 @@
 #include <cstdint>
 #include "stackdb/slice.h"
 #include "stackdb/comparator.h"
+#include "util/coding.h"
 
 namespace stackdb {
     // different kinds of keys in stackdb
@@ -20,7 +21,9 @@ namespace stackdb {
     enum class ValType{
         DELETION = 0x0,
         VALUE = 0x1,
-        SEEK = VALUE
+        RANGE_DELETION = 0x2,   // deletes user keys in [key, value) written before it
+        MERGE = 0x3,            // value is an operand for the MergeOperator, applied to older entries
+        SEEK = MERGE            // highest type, so a seek key sorts before all types of its seq
     };
 
     typedef uint64_t SeqNum;
@@ -48,6 +51,23 @@ namespace stackdb {
         return Slice(internal_key.data(), internal_key.size() - 8);
     }
 
+    // order internal keys by user key, then by decreasing seq/type trailer compared as one
+    // integer. user_cmp is a template parameter so that a user comparator known at compile
+    // time, like BytewiseCompare, is inlined instead of called through Comparator
+    template <typename UserComparator>
+    inline int compare_internal_keys(const UserComparator &user_cmp, const Slice &a, const Slice &b) {
+        int res = user_cmp.compare(extract_user_key(a), extract_user_key(b));
+        if (res == 0) {
+            uint64_t a_seq_type = decode_fixed_64(a.data() + a.size() - 8);
+            uint64_t b_seq_type = decode_fixed_64(b.data() + b.size() - 8);
+            res = (a_seq_type > b_seq_type) ? -1 : (a_seq_type < b_seq_type); // newer is smaller
+        }
+        return res;
+    }
+    // what bytewise_comparator() does, for compare_internal_keys()
+    struct BytewiseCompare {
+        int compare(const Slice &a, const Slice &b) const { return a.compare(b); }
+    };
 
     class InternalKey {
     public:
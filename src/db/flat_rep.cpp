@@ -0,0 +1,94 @@
+#include <algorithm>
+#include "db/memtable_rep.h"
+
+namespace stackdb {
+namespace {
+    // a read-only copy of a rep's entries in a sorted array. each slot carries the key prefix
+    // of its entry, so a binary search mostly compares integers in the array, and only
+    // follows entry pointers into the arena when prefixes are equal. Cmp is
+    // BytewiseMemTableKeyComparator when possible, like SkipListRep
+    template <typename Cmp>
+    class FlatRep: public MemTableRep {
+    public:
+        FlatRep(const Cmp &cmp, MemTableRep *source): cmp(cmp), use_prefix(cmp.key_prefix_enabled()) {
+            MemTableRep::Iterator *iter = source->new_iterator();
+            for (iter->seek_to_first(); iter->valid(); iter->next()) {
+                slots.push_back(Slot{prefix_of(iter->key()), iter->key()});
+            }
+            delete iter;
+            slots.shrink_to_fit();
+        }
+
+        void insert(const char *entry) override { assert(false); }
+        void insert_concurrently(const char *entry) override { assert(false); }
+
+        void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) override {
+            for (size_t i = lower_bound(key, 0); i < slots.size() && callback(arg, slots[i].entry); i ++) {}
+        }
+        // sorted keys only search the slots after the last one found
+        void multi_get(size_t n, const char *const *keys, void *const *args,
+                       bool (*callback)(void *arg, const char *entry)) override {
+            size_t first = 0;
+            for (size_t k = 0; k < n; k ++) {
+                if (first < slots.size() && !is_after(keys[k], prefix_of(keys[k]), slots[first])) {
+                    first = 0;      // not sorted, search all
+                }
+                first = lower_bound(keys[k], first);
+                for (size_t i = first; i < slots.size() && callback(args[k], slots[i].entry); i ++) {}
+            }
+        }
+        MemTableRep::Iterator *new_iterator() override { return new Iterator(this); }
+        size_t approxi_mem_usage() const override { return slots.capacity() * sizeof(Slot); }
+
+    private:
+        struct Slot {
+            uint64_t prefix;    // of entry, or 0 if prefixes are not in use
+            const char *entry;
+        };
+
+        uint64_t prefix_of(const char *key) const { return use_prefix ? cmp.key_prefix(key) : 0; }
+        // whether key comes after the entry of slot. prefixes decide the order unless they are equal
+        bool is_after(const char *key, uint64_t key_prefix, const Slot &slot) const {
+            if (slot.prefix != key_prefix) return slot.prefix < key_prefix;
+            return cmp(slot.entry, key) < 0;
+        }
+        // index of the first slot at or after key, starting from first
+        size_t lower_bound(const char *key, size_t first) const {
+            uint64_t key_prefix = prefix_of(key);
+            auto iter = std::lower_bound(slots.begin() + first, slots.end(), key,
+                [this, key_prefix](const Slot &slot, const char *key) { return is_after(key, key_prefix, slot); });
+            return iter - slots.begin();
+        }
+
+        class Iterator: public MemTableRep::Iterator {
+        public:
+            explicit Iterator(const FlatRep *rep): rep(rep), pos(rep->slots.size()) {}
+            bool valid() const override { return pos < rep->slots.size(); }
+            const char *key() const override { assert(valid()); return rep->slots[pos].entry; }
+            void next() override { assert(valid()); pos ++; }
+            void prev() override {      // stepping back from the first entry invalidates
+                assert(valid());
+                pos = (pos == 0) ? rep->slots.size() : pos - 1;
+            }
+            void seek(const char *key) override { pos = rep->lower_bound(key, 0); }
+            void seek_to_first() override { pos = 0; }
+            void seek_to_last() override { pos = rep->slots.empty() ? 0 : rep->slots.size() - 1; }
+        private:
+            const FlatRep *const rep;
+            size_t pos;     // rep->slots.size() if not valid
+        };
+
+        const Cmp cmp;
+        const bool use_prefix;
+        std::vector<Slot> slots;
+    };
+} // anonymous namespace
+
+MemTableRep *new_flat_rep(const MemTableKeyComparator &cmp, MemTableRep *source) {
+    if (cmp.comparator.user_comparator() == bytewise_comparator()) {
+        return new FlatRep<BytewiseMemTableKeyComparator>(BytewiseMemTableKeyComparator(cmp), source);
+    }
+    return new FlatRep<MemTableKeyComparator>(cmp, source);
+}
+
+} // namespace stackdb
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include "db/memtable_rep.h"
+#include "util/hash.h"
+
+namespace stackdb {
+namespace {
+    // entries hashed by user key prefix into buckets. each bucket is a sorted singly
+    // linked list, published with release stores like level 0 of SkipList
+    class HashBucketRep: public MemTableRep {
+    public:
+        HashBucketRep(const MemTableKeyComparator &cmp, Arena *arena, size_t bucket_count, size_t prefix_length)
+            : cmp(cmp), arena(arena), bucket_count(bucket_count), prefix_length(prefix_length), count(0) {
+            assert(bucket_count > 0);
+            char *mem = arena->allocate_aligned(sizeof(std::atomic<Node *>) * bucket_count);
+            buckets = reinterpret_cast<std::atomic<Node *> *>(mem);
+            for (size_t i = 0; i < bucket_count; i ++) {
+                new (&buckets[i]) std::atomic<Node *>(nullptr);
+            }
+        }
+
+        void insert(const char *entry) override { insert_node(entry, false); }
+        void insert_concurrently(const char *entry) override { insert_node(entry, true); }
+
+        void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) override {
+            Node *node = bucket_of(key)->load(std::memory_order_acquire);
+            while (node != nullptr && cmp(node->entry, key) < 0) {
+                node = node->next.load(std::memory_order_acquire);
+            }
+            for (; node != nullptr && callback(arg, node->entry);
+                   node = node->next.load(std::memory_order_acquire)) {}
+        }
+
+        // gather every bucket and sort. costs O(n log n) per iterator
+        MemTableRep::Iterator *new_iterator() override {
+            auto entries = std::make_shared<std::vector<const char *>>();
+            entries->reserve(count.load(std::memory_order_relaxed));
+            for (size_t i = 0; i < bucket_count; i ++) {
+                for (Node *node = buckets[i].load(std::memory_order_acquire); node != nullptr;
+                           node = node->next.load(std::memory_order_acquire)) {
+                    entries->push_back(node->entry);
+                }
+            }
+            std::sort(entries->begin(), entries->end(),
+                      [this](const char *a, const char *b) { return cmp(a, b) < 0; });
+            return new_snapshot_iterator(cmp, entries);
+        }
+
+    private:
+        struct Node {
+            explicit Node(const char *entry): entry(entry), next(nullptr) {}
+            const char *const entry;
+            std::atomic<Node *> next;
+        };
+
+        std::atomic<Node *> *bucket_of(const char *entry) const {
+            Slice user_key = extract_user_key(get_length_prefixed_slice(entry));
+            size_t n = std::min(user_key.size(), prefix_length);
+            return &buckets[hash(user_key.data(), n, 0) % bucket_count];
+        }
+
+        void insert_node(const char *entry, bool concurrent) {
+            char *mem = concurrent ? arena->allocate_aligned_concurrently(sizeof(Node))
+                                   : arena->allocate_aligned(sizeof(Node));
+            Node *node = new (mem) Node(entry);
+
+            std::atomic<Node *> *link = bucket_of(entry);
+            while (true) {
+                // find the first link that points at or after entry
+                Node *next = link->load(std::memory_order_acquire);
+                while (next != nullptr && cmp(next->entry, entry) < 0) {
+                    link = &next->next;
+                    next = link->load(std::memory_order_acquire);
+                }
+                assert(next == nullptr || cmp(next->entry, entry) != 0);
+                node->next.store(next, std::memory_order_relaxed);
+                if (!concurrent) {
+                    link->store(node, std::memory_order_release);
+                    break;
+                }
+                // on a race, rescan from the same link. it still points before entry
+                if (link->compare_exchange_strong(next, node, std::memory_order_acq_rel)) {
+                    break;
+                }
+            }
+            count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        const MemTableKeyComparator cmp;
+        Arena *const arena;
+        const size_t bucket_count;
+        const size_t prefix_length;
+        std::atomic<Node *> *buckets;   // allocated in arena
+        std::atomic<size_t> count;      // num of entries, to size iterator snapshots
+    };
+
+    class HashBucketRepFactory: public MemTableRepFactory {
+    public:
+        HashBucketRepFactory(size_t bucket_count, size_t prefix_length)
+            : bucket_count(bucket_count), prefix_length(prefix_length) {}
+        const char *name() const override { return "stackdb.HashBucketRep"; }
+        MemTableRep *create(const MemTableKeyComparator &cmp, Arena *arena) const override {
+            return new HashBucketRep(cmp, arena, bucket_count, prefix_length);
+        }
+    private:
+        const size_t bucket_count;
+        const size_t prefix_length;
+    };
+} // anonymous namespace
+
+MemTableRepFactory *new_hash_bucket_rep_factory(size_t bucket_count, size_t prefix_length) {
+    return new HashBucketRepFactory(bucket_count, prefix_length);
+}
+
+} // namespace stackdb
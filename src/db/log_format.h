@@ -12,12 +12,21 @@ namespace stackdb {
             // record fragments
             FIRST_TYPE = 2,
             MIDDLE_TYPE = 3,
-            LAST_TYPE = 4
+            LAST_TYPE = 4,
+            // recyclable record format, whose header also carries the log number. a reused log
+            // file still holds records of its previous log after the new ones, and those are
+            // told apart by their log number
+            RECYCLABLE_FULL_TYPE = 5,
+            RECYCLABLE_FIRST_TYPE = 6,
+            RECYCLABLE_MIDDLE_TYPE = 7,
+            RECYCLABLE_LAST_TYPE = 8
         };
-        const int MAX_RECORD_TYPE = LAST_TYPE;
+        const int MAX_RECORD_TYPE = RECYCLABLE_LAST_TYPE;
 
         const int BLOCK_SIZE = 32 * 1024;
         const int HEADER_SIZE = 4 + 2 + 1; // checksum 4 + length 2 + type 1
+        // checksum 4 + length 2 + type 1 + low 32 bits of log number 4. checksum covers the log number too
+        const int RECYCLABLE_HEADER_SIZE = HEADER_SIZE + 4;
     }
 }
 
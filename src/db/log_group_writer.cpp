@@ -0,0 +1,68 @@
+#include <vector>
+#include "db/log_group_writer.h"
+
+namespace stackdb {
+namespace log {
+
+struct GroupWriter::Waiter {
+    Waiter(const Slice &record, bool sync): record(record), sync(sync), done(false) {}
+
+    const Slice &record;
+    const bool sync;
+    bool done;      // written by a leader
+    Status status;
+    std::condition_variable cv;
+};
+
+Status GroupWriter::add_record(const Slice &record, bool sync) {
+    Waiter w(record, sync);
+    std::unique_lock<std::mutex> lock(mutex);
+    waiters.push_back(&w);
+    while (!w.done && &w != waiters.front()) {
+        w.cv.wait(lock);
+    }
+    if (w.done) {
+        return w.status;
+    }
+
+    // lead a group of the waiters queued so far. a sync record doesn't join a group that
+    // won't sync, since the leader's writer returns before it would be synced
+    std::vector<Slice> records;
+    Waiter *last = &w;
+    size_t size = 0;
+    const size_t max_size = max_group_size(record.size());
+    for (Waiter *waiter : waiters) {
+        if (waiter->sync && !w.sync) break;
+        if (waiter != &w && size + waiter->record.size() > max_size) break;
+        records.push_back(waiter->record);
+        size += waiter->record.size();
+        last = waiter;
+    }
+
+    // write without the lock, so others can queue up for the next group meanwhile. only
+    // the leader uses writer
+    lock.unlock();
+    Status s = writer->add_records(records.data(), records.size());
+    if (s.ok() && w.sync) {
+        s = writer->sync();
+    }
+    lock.lock();
+
+    while (true) {
+        Waiter *done = waiters.front();
+        waiters.pop_front();
+        if (done != &w) {
+            done->status = s;
+            done->done = true;
+            done->cv.notify_one();
+        }
+        if (done == last) break;
+    }
+    if (!waiters.empty()) {     // wake the next leader
+        waiters.front()->cv.notify_one();
+    }
+    return s;
+}
+
+} // namespace log
+} // namespace stackdb
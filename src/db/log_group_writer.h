@@ -0,0 +1,43 @@
+#ifndef STACKDB_LOG_GROUP_WRITER_H
+#define STACKDB_LOG_GROUP_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "db/log_writer.h"
+
+namespace stackdb {
+    namespace log {
+        // group commit on top of a Writer. concurrent add_record() calls queue up, and the one
+        // at the front becomes leader: it appends the records of the writers queued behind it
+        // with one flush and, if any of them asked for it, one sync, then wakes them with the
+        // result. so under load, many writers share a single write and fdatasync
+        class GroupWriter {
+        public:
+            // *writer must remain alive for the group writer, and only be used through it
+            explicit GroupWriter(Writer *writer): writer(writer) {}
+            GroupWriter(const GroupWriter&) = delete;
+            GroupWriter &operator=(const GroupWriter &) = delete;
+
+            // add record to the log, and sync it if sync is true. records of writers in one group
+            // are written in queue order. thread-safe
+            Status add_record(const Slice &record, bool sync);
+
+        private:
+            struct Waiter;
+            // the largest group led by a record of size bytes
+            static size_t max_group_size(size_t size) {
+                return size <= SMALL_RECORD_SIZE ? size + SMALL_RECORD_SIZE : MAX_GROUP_SIZE;
+            }
+            // cap groups, so a small write isn't held up by a big group
+            const static size_t MAX_GROUP_SIZE = 1 << 20;
+            const static size_t SMALL_RECORD_SIZE = 128 << 10;
+
+            Writer *const writer;
+            std::mutex mutex;
+            std::deque<Waiter *> waiters;   // guarded by mutex. front is the leader
+        };
+    } // namespace log
+}
+
+#endif
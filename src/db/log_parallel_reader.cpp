@@ -0,0 +1,151 @@
+#include <algorithm>
+#include "stackdb/env.h"
+#include "db/log_parallel_reader.h"
+
+namespace stackdb {
+namespace log {
+
+struct ParallelReader::Chunk {
+    Chunk(): ends(false) {}
+
+    std::unique_ptr<char[]> scratch;
+    std::vector<Event> events;      // in file order
+    bool ends;                      // the log ends in this chunk
+};
+
+ParallelReader::ParallelReader(RandomAccessFile *file, uint64_t file_size, Reporter *reporter, bool checksum,
+                               int num_threads, uint64_t log_number)
+    : Reader(reporter, checksum, log_number), file(file), file_size(file_size),
+      num_chunks(file_size / CHUNK_SIZE + 1), max_chunks_ahead(2 * std::max(num_threads, 1)),
+      chunks(num_chunks), next_chunk(0), end_chunk(num_chunks), current(0), next_event(0),
+      done(false), shutting_down(false) {
+    for (int i = 0; i < std::max(num_threads, 1); i ++) {
+        workers.emplace_back(&ParallelReader::run_worker, this);
+    }
+}
+
+ParallelReader::~ParallelReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutting_down = true;
+    }
+    cv.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ParallelReader::run_worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] {
+            return shutting_down || next_chunk >= end_chunk || next_chunk < current + max_chunks_ahead;
+        });
+        if (shutting_down || next_chunk >= end_chunk) {
+            return;
+        }
+        const size_t index = next_chunk ++;
+
+        lock.unlock();
+        std::unique_ptr<Chunk> chunk(new Chunk);
+        parse_chunk(index, chunk.get());
+        lock.lock();
+
+        if (chunk->ends) {      // no need to parse chunks past the end
+            end_chunk = std::min(end_chunk, index + 1);
+        }
+        chunks[index] = std::move(chunk);
+        cv.notify_all();
+    }
+}
+
+// split the chunk into physical records as read_physical_record() of Reader would, block by block
+void ParallelReader::parse_chunk(size_t index, Chunk *chunk) const {
+    const uint64_t start = index * CHUNK_SIZE;
+    const size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, file_size - start));
+    chunk->scratch.reset(new char[n]);
+    Slice data;
+    Status s = file->read(start, n, &data, chunk->scratch.get());
+    if (!s.ok()) {          // treat error as eof
+        chunk->events.push_back(Event{EOF_TYPE, Slice(), start, BLOCK_SIZE, nullptr, s});
+        chunk->ends = true;
+        return;
+    }
+
+    for (size_t pos = 0; pos < data.size() || data.size() < CHUNK_SIZE; pos += BLOCK_SIZE) {
+        const size_t block_size = std::min<size_t>(BLOCK_SIZE, data.size() - pos);
+        Slice buffer(data.data() + pos, block_size);
+        const bool eof = block_size < BLOCK_SIZE;   // eof only if read bytes < BLOCK_SIZE
+        while (buffer.size() >= HEADER_SIZE) {
+            Event e{0, Slice(), start + pos + (block_size - buffer.size()), 0, nullptr, Status::OK()};
+            e.type = parse_physical_record(&buffer, eof, checksum, log_number, &e.fragment,
+                                           &e.drop_size, &e.reason);
+            chunk->events.push_back(e);
+            if (e.type == EOF_TYPE || e.type == OLD_TYPE) {
+                chunk->ends = true;
+                return;
+            }
+        }
+        if (eof) {
+            chunk->events.push_back(Event{EOF_TYPE, Slice(), start + pos + block_size, 0, nullptr, Status::OK()});
+            chunk->ends = true;
+            return;
+        }
+    }
+}
+
+const ParallelReader::Event &ParallelReader::peek_event() {
+    while (true) {
+        Chunk *chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return chunks[current] != nullptr; });
+            chunk = chunks[current].get();
+        }
+        if (next_event < chunk->events.size()) {
+            return chunk->events[next_event];
+        }
+        // done with the chunk. parse another in its place
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks[current].reset();
+        current ++;
+        next_event = 0;
+        cv.notify_all();
+    }
+}
+
+unsigned int ParallelReader::read_physical_record(Slice* result) {
+    if (done) {
+        result->clear();
+        return EOF_TYPE;
+    }
+    Event e = peek_event();     // a copy, as the chunk may be dropped by peeking past it
+    next_event ++;
+    if (e.type == TORN_TYPE) {
+        // as Reader, corruption if the next block starts with a record of the log, else the end
+        const Event &next = peek_event();
+        if (next.type <= MAX_RECORD_TYPE) {
+            e.type = BAD_TYPE;
+        } else {
+            e.type = OLD_TYPE;
+            e.reason = nullptr;
+            if (!next.status.ok()) {    // a read error, which Reader reports as it peeks too
+                report_drop(next.drop_size, next.status);
+            }
+        }
+    }
+    if (e.reason != nullptr) {
+        report_corruption(e.drop_size, e.reason);
+    } else if (!e.status.ok()) {
+        report_drop(e.drop_size, e.status);
+    }
+    if (e.type == EOF_TYPE || e.type == OLD_TYPE) {
+        done = true;
+    }
+    physical_record_offset = e.offset;
+    *result = e.fragment;
+    return e.type;
+}
+
+}
+}
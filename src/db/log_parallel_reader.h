@@ -0,0 +1,68 @@
+#ifndef STACKDB_LOG_PARALLEL_READER_H
+#define STACKDB_LOG_PARALLEL_READER_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "db/log_reader.h"
+
+namespace stackdb {
+    class RandomAccessFile;
+
+    namespace log {
+        // a Reader for recovery of large logs. the file is split into chunks of whole blocks, which
+        // worker threads read and check the physical records of, a few chunks ahead of the caller.
+        // read_record() then stitches fragments in order as Reader does, so the records and
+        // corruption reports are the same as those of a Reader from the start of the file
+        class ParallelReader: public Reader {
+        public:
+            // read the first file_size bytes of *file with num_threads threads. *file must remain
+            // alive for the reader. other arguments are as for Reader
+            ParallelReader(RandomAccessFile *file, uint64_t file_size, Reporter *reporter, bool checksum,
+                           int num_threads, uint64_t log_number = 0);
+            ~ParallelReader() override;
+
+        protected:
+            unsigned int read_physical_record(Slice* result) override;
+
+        private:
+            struct Chunk;
+            // a physical record, or what read_physical_record() returns in place of one
+            struct Event {
+                unsigned int type;
+                Slice fragment;
+                uint64_t offset;
+                size_t drop_size;       // reported if reason is set or status is not ok
+                const char *reason;
+                Status status;
+            };
+
+            void run_worker();
+            // the next event, without consuming it. waits for its chunk to be parsed
+            const Event &peek_event();
+            void parse_chunk(size_t index, Chunk *chunk) const;
+
+            constexpr static size_t CHUNK_SIZE = 16 * BLOCK_SIZE;
+
+            RandomAccessFile *const file;
+            const uint64_t file_size;
+            const size_t num_chunks;        // including the one with the empty read at eof, if any
+            const size_t max_chunks_ahead;  // bounds memory held by parsed chunks
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<std::unique_ptr<Chunk>> chunks;     // guarded by mutex. parsed ones
+            size_t next_chunk;              // guarded by mutex. next to parse
+            size_t end_chunk;               // guarded by mutex. chunks from here are past the log end
+            size_t current;                 // chunk read from. written by the caller with mutex held
+            size_t next_event;              // in current chunk. only the caller uses it
+            bool done;                      // log end returned. only the caller uses it
+            bool shutting_down;             // guarded by mutex
+            std::vector<std::thread> workers;
+        };
+    } // namespace log
+}
+
+#endif
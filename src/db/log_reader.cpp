@@ -45,8 +45,6 @@ namespace stackdb {
 
             while (true) {
                 const unsigned int record_type = read_physical_record(&fragment);
-                uint64_t physical_record_offset = buffer_end_offset 
-                            - buffer.size() - HEADER_SIZE - fragment.size();
 
                 if (resyncing) {    // effective if init_offset is at block boundaries
                     if (record_type == MIDDLE_TYPE) {
@@ -108,6 +106,12 @@ namespace stackdb {
                         }
                         return false;
 
+                    case OLD_TYPE:                  // the log ends here in a reused file
+                        if (in_fragmented_record) {
+                            scratch->clear();
+                        }
+                        return false;
+
                     case BAD_TYPE:
                         if (in_fragmented_record) {
                             report_corruption(scratch->size(), "error in middle of record");
@@ -129,12 +133,12 @@ namespace stackdb {
             return false;
         }
 
-        unsigned int Reader::read_physical_record(Slice* result) {
+        bool Reader::refill_buffer() {
             // try refill buffer for next record, if buffer can't fit a header
             while (buffer.size() < HEADER_SIZE) {
-                if (eof) {              // no data available. return EOF
+                if (eof) {              // no data available
                     buffer.clear();
-                    return EOF_TYPE;
+                    return false;
                 }
                 buffer.clear();          // skip trailer and read a new block
                 Status status = file->read(BLOCK_SIZE, &buffer, backing_block);
@@ -144,56 +148,110 @@ namespace stackdb {
                     buffer.clear();
                     report_drop(BLOCK_SIZE, status);
                     eof = true;
-                    return EOF_TYPE;
+                    return false;
                 } 
                 if (buffer.size() < BLOCK_SIZE) { // set eof if read < BLOCK_SIZE
                     eof = true;
                 }
             }
+            return true;
+        }
+
+        unsigned int Reader::read_physical_record(Slice* result) {
+            if (!refill_buffer()) {
+                return EOF_TYPE;
+            }
             // now header in buffer. try parse it
-            const char *header = buffer.data();
+            const uint64_t offset = buffer_end_offset - buffer.size();
+            size_t drop_size = 0;
+            const char *reason = nullptr;
+            unsigned int type = parse_physical_record(&buffer, eof, checksum, log_number, result,
+                                                      &drop_size, &reason);
+            if (type == TORN_TYPE) {
+                // peek at the start of the next block, where the rest of the log would go on
+                Slice next;
+                type = OLD_TYPE;
+                if (refill_buffer()) {
+                    Slice peeked = buffer;
+                    size_t peeked_drop_size = 0;
+                    const char *peeked_reason = nullptr;
+                    if (parse_physical_record(&peeked, eof, checksum, log_number, &next, &peeked_drop_size,
+                                              &peeked_reason) <= MAX_RECORD_TYPE) {
+                        type = BAD_TYPE;
+                    }
+                }
+                if (type == OLD_TYPE) {
+                    buffer.clear();
+                    reason = nullptr;
+                }
+                result->clear();
+            }
+            if (reason != nullptr) {
+                report_corruption(drop_size, reason);
+            }
+            if (type == OLD_TYPE) {
+                eof = true;
+            } else if (type != EOF_TYPE && type != BAD_TYPE) {
+                physical_record_offset = offset;
+                // skip physical record that started before init_offset
+                if (offset < init_offset) {
+                    result->clear();
+                    return BAD_TYPE;
+                }
+            }
+            return type;
+        }
+
+        unsigned int Reader::parse_physical_record(Slice *buffer, bool eof, bool checksum, uint64_t log_number,
+                                                   Slice *result, size_t *drop_size, const char **reason) {
+            const char *header = buffer->data();
             uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
             uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
             uint32_t length = a | (b << 8);
-            uint32_t type = header[6];
+            uint32_t type = static_cast<uint8_t>(header[6]);
+            const bool recyclable = (type >= RECYCLABLE_FULL_TYPE && type <= RECYCLABLE_LAST_TYPE);
+            const size_t header_size = recyclable ? RECYCLABLE_HEADER_SIZE : HEADER_SIZE;
 
             // ensure buffer holds current record
-            if (HEADER_SIZE + length > buffer.size()) {
-                size_t drop_size = buffer.size();
-                buffer.clear();
+            if (header_size + length > buffer->size()) {
+                *drop_size = buffer->size();
+                buffer->clear();
                 if (!eof) {
-                    report_corruption(drop_size, "bad record length");
-                    return BAD_TYPE;
+                    *reason = "bad record length";
+                    return log_number != 0 ? TORN_TYPE : BAD_TYPE;
                 }
                 return EOF_TYPE;    // no report. assume writer died while writing the record
             }
             // return if empty record. current no support for it
             if (type == ZERO_TYPE && length == 0) {
-                buffer.clear();
+                buffer->clear();
                 return BAD_TYPE;
             }
 
-            // check record crc32
+            // check record crc32, which covers type, log number if any, and payload
             if (checksum) {
                 uint32_t actual_crc = crc32c::unmask(decode_fixed_32(header));
-                uint32_t expected_crc = crc32c::value(header + 6, 1 + length);
+                uint32_t expected_crc = crc32c::value(header + 6, header_size - 6 + length);
                 if (actual_crc != expected_crc) {
-                    size_t drop_size = buffer.size();       // drop rest of buffer
-                    buffer.clear();
-                    report_corruption(drop_size, "checksum mismatch");
-                    return BAD_TYPE;
+                    *drop_size = buffer->size();       // drop rest of buffer
+                    buffer->clear();
+                    *reason = "checksum mismatch";
+                    return log_number != 0 ? TORN_TYPE : BAD_TYPE;
                 }
             }
+            // a record of another log, or a legacy one, ends this one. stop here for good
+            if (log_number != 0 && (!recyclable
+                    || decode_fixed_32(header + HEADER_SIZE) != static_cast<uint32_t>(log_number))) {
+                buffer->clear();
+                return OLD_TYPE;
+            }
             // record ok, consume it in buffer
-            buffer.remove_prefix(HEADER_SIZE + length);
+            buffer->remove_prefix(header_size + length);
 
-            // skip physical record that started before init_offset
-            if (buffer_end_offset - buffer.size() - HEADER_SIZE - length < init_offset) {
-                result->clear();
-                return BAD_TYPE;
+            *result = Slice(header + header_size, length);
+            if (recyclable) {   // to the plain type of the same fragment
+                type -= RECYCLABLE_FULL_TYPE - FULL_TYPE;
             }
-
-            *result = Slice(header + HEADER_SIZE, length);
             return type;
         }
 
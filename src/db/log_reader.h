@@ -1,5 +1,5 @@
 #ifndef STACKDB_LOG_READER_H
-#define STACKDB_LOG_READER_h
+#define STACKDB_LOG_READER_H
 
 #include <string>
 #include <cstdint>
@@ -24,27 +24,52 @@ namespace stackdb {
             //  if reporter not null, it is notified whenever some data is dropped due to detected corruption
             //  if checksum is true, verify checksums TODO: if available?
             //  reader reads firt record at position >= init_offset in the file
-            explicit Reader(SequentialFile *file, Reporter *reporter, bool checksum, uint64_t init_offset)
-                : file(file), reporter(reporter), checksum(checksum),                   // params
+            //  if file returns slices into a mapping of the file, as from Env::new_mmap_sequential_file(),
+            //  records that aren't fragmented point into it and aren't copied
+            //  if log_number is not 0, the file is a log written in the recyclable format with that
+            //  number, and reading stops cleanly at the first record of another log, which is left
+            //  over from the log the file was reused from. a broken record ends it cleanly too,
+            //  unless the next block starts with a record of the log, proving it corruption
+            explicit Reader(SequentialFile *file, Reporter *reporter, bool checksum, uint64_t init_offset,
+                            uint64_t log_number = 0)
+                : reporter(reporter), checksum(checksum), log_number(log_number), file(file),   // params
                   backing_block(new char[BLOCK_SIZE]), buffer(), eof(false),            // block & buf
                   last_record_offset(0), buffer_end_offset(0), init_offset(init_offset),// offsets
-                  resyncing(init_offset > 0) {}
+                  resyncing(init_offset > 0), physical_record_offset(0) {}
 
-            ~Reader() { delete[] backing_block; }
+            virtual ~Reader() { delete[] backing_block; }
 
             bool read_record(Slice* record, std::string* scratch);  // read next record into *record. 
             uint64_t get_last_record_offset() {                     // returns physical offset of last record returned by read_record()
                 return last_record_offset;
             }
 
-        private:
+        protected:
             enum {  // extent two record types: EOF: hit input end, BAD: invalid crc, 0-lenth, below init_offset
                 EOF_TYPE = MAX_RECORD_TYPE + 1,
-                BAD_TYPE = MAX_RECORD_TYPE + 2
+                BAD_TYPE = MAX_RECORD_TYPE + 2,
+                OLD_TYPE = MAX_RECORD_TYPE + 3, // a record left over from the previous log of a reused file
+                TORN_TYPE = MAX_RECORD_TYPE + 4 // a broken record of a recyclable log. corruption if the
+                                                // next block starts with a record of the log, else its end
             };
-            
-            bool skip_to_init_block();          // skips all blocks that are completely before init_offset. 
-            unsigned int read_physical_record(Slice* result);           // return type, or one of the preceding special values
+
+            // for readers that get physical records elsewhere, by overriding read_physical_record()
+            Reader(Reporter *reporter, bool checksum, uint64_t log_number) 
+                : reporter(reporter), checksum(checksum), log_number(log_number), file(nullptr),
+                  backing_block(nullptr), buffer(), eof(false),
+                  last_record_offset(0), buffer_end_offset(0), init_offset(0),
+                  resyncing(false), physical_record_offset(0) {}
+
+            // return type, or one of the preceding special values. sets physical_record_offset
+            // for a physical record
+            virtual unsigned int read_physical_record(Slice* result);
+            // parse the physical record at the front of *buffer, which holds at least HEADER_SIZE
+            // bytes and no more than the rest of a block, and consume it. eof is true if *buffer
+            // ends the file. returns as read_physical_record(), or TORN_TYPE, and if bytes are
+            // dropped, sets *drop_size and *reason for report_corruption(). for TORN_TYPE, the
+            // caller reports them only once a record of the log is found to follow
+            static unsigned int parse_physical_record(Slice *buffer, bool eof, bool checksum, uint64_t log_number,
+                                                      Slice *result, size_t *drop_size, const char **reason);
 
             // reports dropped bytes to the reporter. 
             void report_corruption(uint64_t bytes, const char* reason) {
@@ -57,10 +82,15 @@ namespace stackdb {
                 }
             }
 
-        private:
-            SequentialFile* const file;
             Reporter* const reporter;
             bool const checksum;
+            uint64_t const log_number;
+
+        private:
+            bool skip_to_init_block();          // skips all blocks that are completely before init_offset. 
+            bool refill_buffer();               // reads blocks until buffer fits a header. false at the end
+
+            SequentialFile* const file;
 
             char* const backing_block;      // each time backs a new block
             Slice buffer;                   // normally covers entire backing_block, unless last block
@@ -73,6 +103,9 @@ namespace stackdb {
             // true if resynchronizing after a seek (init_offset > 0).  skip a run of MIDDLE_TYPE and 
             // a LAST_TYPE partial records to find the first logical record after init_offset
             bool resyncing;                 
+
+        protected:
+            uint64_t physical_record_offset;    // file offset of last physical record read
         };
 
 
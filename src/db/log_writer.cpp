@@ -14,15 +14,122 @@ static void init_type_crc(uint32_t *type_crc) {
     }
 }
 
-Writer::Writer(WritableFile* dest) : dest(dest), block_offset(0) {
+Writer::Writer(WritableFile* dest, const WriterOptions &options) : Writer(dest, 0, options) {}
+Writer::Writer(WritableFile* dest, uint64_t dest_length, const WriterOptions &options)
+    : dest(dest), options(options), header_size(options.log_number != 0 ? RECYCLABLE_HEADER_SIZE : HEADER_SIZE),
+      block_offset(dest_length % BLOCK_SIZE), file_offset(dest_length), preallocated_end(dest_length),
+      unflushed_bytes(0), unsynced(false), shutting_down(false) {
     init_type_crc(type_crc);
+    if (options.flush_interval_micros > 0 || options.sync_interval_millis > 0) {
+        background_thread = std::thread(&Writer::run_background, this);
+    }
 }
-Writer::Writer(WritableFile* dest, uint64_t dest_length)
-    : dest(dest), block_offset(dest_length % BLOCK_SIZE) {
-    init_type_crc(type_crc);
+
+Writer::~Writer() {
+    if (background_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shutting_down = true;
+        }
+        background_cv.notify_one();
+        background_thread.join();
+    }
+    if (unflushed_bytes > 0) {
+        dest->flush();
+    }
 }
 
 Status Writer::add_record(const Slice &slice) {
+    return add_records(&slice, 1);
+}
+
+Status Writer::add_records(const Slice *records, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Status s = background_status;
+    for (size_t i = 0; i < n && s.ok(); i ++) {
+        s = emit_record(records[i]);
+        unflushed_bytes += records[i].size();
+    }
+    unsynced = true;
+    if (s.ok()) {
+        s = flush_by_policy();
+    }
+    return s;
+}
+
+Status Writer::flush_by_policy() {
+    if (options.flush_bytes > 0 ? unflushed_bytes < options.flush_bytes : options.flush_interval_micros > 0) {
+        return Status::OK();    // left to a later record or the background thread
+    }
+    unflushed_bytes = 0;
+    return dest->flush();
+}
+
+Status Writer::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    unflushed_bytes = 0;
+    Status s = dest->flush();
+    return s.ok() ? background_status : s;
+}
+
+Status Writer::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    Status s = sync_dest(lock);
+    return s.ok() ? background_status : s;
+}
+
+Status Writer::sync_dest(std::unique_lock<std::mutex> &lock) {
+    unflushed_bytes = 0;
+    unsynced = false;       // set again by records added while syncing
+    Status s = dest->flush();
+    if (!s.ok()) {
+        return s;
+    }
+    lock.unlock();
+    s = dest->sync_data();
+    lock.lock();
+    if (s.is_not_supported_error()) {
+        s = dest->sync();   // dest can't sync alongside appends, so it does with lock held
+    }
+    return s;
+}
+
+void Writer::run_background() {
+    typedef std::chrono::steady_clock Clock;
+    const auto flush_interval = std::chrono::microseconds(options.flush_interval_micros);
+    const auto sync_interval = std::chrono::milliseconds(options.sync_interval_millis);
+    auto next_flush = Clock::now() + flush_interval;
+    auto next_sync = Clock::now() + sync_interval;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!shutting_down) {
+        auto wake = options.flush_interval_micros == 0 ? next_sync
+                  : options.sync_interval_millis == 0 ? next_flush : std::min(next_flush, next_sync);
+        background_cv.wait_until(lock, wake);
+        if (shutting_down) break;
+
+        Status s;
+        auto now = Clock::now();
+        if (options.sync_interval_millis > 0 && now >= next_sync) {
+            if (unsynced) {
+                s = sync_dest(lock);
+            }
+            next_sync = now + sync_interval;
+        }
+        if (options.flush_interval_micros > 0 && now >= next_flush) {
+            if (s.ok() && unflushed_bytes > 0) {
+                unflushed_bytes = 0;
+                s = dest->flush();
+            }
+            next_flush = now + flush_interval;
+        }
+        if (!s.ok() && background_status.ok()) {
+            background_status = s;
+        }
+    }
+}
+
+Status Writer::emit_record(const Slice &slice) {
     const char *ptr = slice.data();
     size_t left = slice.size();
     // Fragment the record if necessary and emit it. do it even for empty record
@@ -32,29 +139,31 @@ Status Writer::add_record(const Slice &slice) {
         const int block_leftover = BLOCK_SIZE - block_offset;
         assert(block_leftover >= 0);
         // fill left over with zero if the space not enough for header
-        if (block_leftover < HEADER_SIZE) {
+        if (block_leftover < header_size) {
             if (block_leftover > 0) { // only fill non-empty left over
-                dest->append(Slice("\x00\x00\x00\x00\x00\x00", block_leftover));
+                static const char zeros[RECYCLABLE_HEADER_SIZE] = {0};
+                append(Slice(zeros, block_leftover));
             }
             block_offset = 0;  // indicate switching to a new block
         }
 
-        // Invariant: we never leave < kHeaderSize bytes in a block.
-        assert(BLOCK_SIZE - block_offset - HEADER_SIZE >= 0);
+        // Invariant: we never leave < header_size bytes in a block.
+        assert(BLOCK_SIZE - block_offset - header_size >= 0);
 
-        const size_t avail = BLOCK_SIZE - block_offset - HEADER_SIZE;
+        const size_t avail = BLOCK_SIZE - block_offset - header_size;
         const size_t frag_len = (left < avail) ? left : avail;
 
         RecordType type;    // determine record type by 'begin' and 'end'
         const bool end = (left == frag_len);
+        const bool recyclable = (header_size == RECYCLABLE_HEADER_SIZE);
         if (begin && end) {  
-            type = FULL_TYPE;
+            type = recyclable ? RECYCLABLE_FULL_TYPE : FULL_TYPE;
         } else if (begin) {
-            type = FIRST_TYPE;
+            type = recyclable ? RECYCLABLE_FIRST_TYPE : FIRST_TYPE;
         } else if (end) {
-            type = LAST_TYPE;
+            type = recyclable ? RECYCLABLE_LAST_TYPE : LAST_TYPE;
         } else {
-            type = MIDDLE_TYPE;
+            type = recyclable ? RECYCLABLE_MIDDLE_TYPE : MIDDLE_TYPE;
         }
 
         s = emit_physical_record(type, ptr, frag_len);
@@ -67,32 +176,46 @@ Status Writer::add_record(const Slice &slice) {
 
 Status Writer::emit_physical_record(RecordType type, const char *ptr, size_t length) {
     assert(length <= 0xffff);       // must fit in two bytes
-    assert(block_offset + HEADER_SIZE + length <= BLOCK_SIZE);
+    assert(block_offset + header_size + length <= BLOCK_SIZE);
 
-    // form the header: checksum[0-3] | length[4-5] | type[6]
-    char buf[HEADER_SIZE];
+    // form the header: checksum[0-3] | length[4-5] | type[6] | log number[7-10] if recyclable
+    char buf[RECYCLABLE_HEADER_SIZE];
     buf[4] = static_cast<char>(length & 0xff);
     buf[5] = static_cast<char>(length >> 8);
     buf[6] = static_cast<char>(type);
 
-    // compute crc of record type and payload. mast the computed crc for 
+    // compute crc of record type, log number and payload. mast the computed crc for 
     // storage since it's hard to compute crc of string containing embeded crc
-    uint32_t crc = crc32c::extend(type_crc[type], ptr, length);
+    uint32_t crc = type_crc[type];
+    if (header_size == RECYCLABLE_HEADER_SIZE) {
+        encode_fixed_32(buf + HEADER_SIZE, static_cast<uint32_t>(options.log_number));
+        crc = crc32c::extend(crc, buf + HEADER_SIZE, 4);
+    }
+    crc = crc32c::extend(crc, ptr, length);
     crc = crc32c::mask(crc);  
     encode_fixed_32(buf, crc);
 
     // write header and payload
-    Status s = dest->append(Slice(buf, HEADER_SIZE));
+    Status s = append(Slice(buf, header_size));
     if (s.ok()) {
-        s = dest->append(Slice(ptr, length));
-        if (s.ok()) {
-            s = dest->flush();
-        }
+        s = append(Slice(ptr, length));
     }
-    block_offset += HEADER_SIZE + length;
+    block_offset += header_size + length;
     return s;
 }
 
+Status Writer::append(const Slice &data) {
+    if (options.preallocate_size > 0 && file_offset + data.size() > preallocated_end) {
+        uint64_t end = file_offset + data.size();
+        end = (end + options.preallocate_size - 1) / options.preallocate_size * options.preallocate_size;
+        // only a hint, so appends go on if the file system can't reserve space
+        dest->preallocate(preallocated_end, end - preallocated_end);
+        preallocated_end = end;
+    }
+    file_offset += data.size();
+    return dest->append(data);
+}
+
 }
 }
 
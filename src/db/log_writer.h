@@ -1,7 +1,10 @@
 #ifndef STACKDB_LOG_WRITER_H
 #define STACKDB_LOG_WRITER_H
 
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
+#include <thread>
 #include "stackdb/status.h"
 #include "db/log_format.h"
 
@@ -9,22 +12,77 @@ namespace stackdb {
     class WritableFile; // forward declaration
 
     namespace log {
+        // when a Writer pushes records out of dest's buffer with flush(), and onto disk with
+        // sync(). a process crash loses records not flushed, and a machine crash or power loss
+        // loses records not synced. the default flushes every record, so only a machine
+        // crash loses records, up to those since the caller's last sync()
+        struct WriterOptions {
+            // if nonzero, flush once this many bytes were added since the last flush, rather
+            // than after every record. a process crash loses up to flush_bytes of records
+            size_t flush_bytes = 0;
+            // if nonzero, a background thread also flushes records added for this long, and
+            // records are not flushed after every one either. a process crash loses records of
+            // up to flush_interval_micros, or flush_bytes if that is set and comes first
+            uint64_t flush_interval_micros = 0;
+            // if nonzero, a background thread syncs records added for this long, so a machine
+            // crash loses records of up to sync_interval_millis, besides those the flush
+            // settings above leave in the process
+            uint64_t sync_interval_millis = 0;
+            // if nonzero, file space is reserved this many bytes at a time ahead of appends, so
+            // syncs don't update the file size on disk every time. the file size stays as written
+            size_t preallocate_size = 0;
+            // if nonzero, records are written in the recyclable format with this log number,
+            // so the file can later be reused for another log. see Env::reuse_writable_file()
+            uint64_t log_number = 0;
+        };
+
         class Writer {
         public:
             // create a writer that will append data to *dest
             // *dest must be initially empty and remain alive for the writer
-            explicit Writer(WritableFile *dest);
-            Writer(WritableFile *dest, uint64_t dest_length);
+            explicit Writer(WritableFile *dest, const WriterOptions &options = WriterOptions());
+            Writer(WritableFile *dest, uint64_t dest_length, const WriterOptions &options = WriterOptions());
             Writer(const Writer&) = delete;
-            ~Writer() = default;
+            // flushes records not flushed yet
+            ~Writer();
             Writer &operator=(const Writer &) = delete;
 
             Status add_record(const Slice &slice);
+            // append n records with one flush of dest at the end, rather than one each
+            Status add_records(const Slice *records, size_t n);
+            // flush dest, so records added so far survive a process crash
+            Status flush();
+            // sync dest, so records added so far survive a crash
+            Status sync();
 
         private:
+            // the flush and sync policy of options after records were added. requires mutex held
+            Status flush_by_policy();
+            // flush dest, then sync it with lock released so records can be added meanwhile.
+            // requires lock held, which it is again on return
+            Status sync_dest(std::unique_lock<std::mutex> &lock);
+            // flushes and syncs records on interval. runs in background_thread
+            void run_background();
+            // fragment slice into physical records, without flushing dest
+            Status emit_record(const Slice &slice);
+            // append data to dest, reserving space ahead by options.preallocate_size
+            Status append(const Slice &data);
             Status emit_physical_record(RecordType type, const char *ptr, size_t length);
             WritableFile *dest;
+            const WriterOptions options;
+            const int header_size;
             int block_offset;   // current offset in block
+            uint64_t file_offset;       // where the next append goes
+            uint64_t preallocated_end;  // end of space reserved with preallocate()
+
+            // guards dest and state below, shared with background_thread
+            std::mutex mutex;
+            size_t unflushed_bytes;     // added since the last flush
+            bool unsynced;              // records added since the last sync
+            Status background_status;   // first error of background_thread, returned by later calls
+            bool shutting_down;
+            std::condition_variable background_cv;
+            std::thread background_thread;  // not started unless a background interval is set
             // pre-computed crc32c header values for all supported record typesss
             uint32_t type_crc[MAX_RECORD_TYPE + 1];
         };
@@ -1,45 +1,112 @@
+#include <algorithm>
 #include "db/memtable.h"
 #include "util/coding.h"
 
 namespace stackdb {
 
-// get slice representaion of internal key from memtable key
-Slice get_length_prefixed_slice(const char *data) {
-    uint32_t size;
-    const char *p = data;
-    p = get_varint_32_ptr(p, p + 5, &size);   // assume p is not corrupted
-    return Slice(p, size);
+static const MemTableRepFactory *default_rep_factory() {
+    static const MemTableRepFactory *factory = new_skiplist_rep_factory();
+    return factory;
 }
 
-int MemTable::KeyComparator::operator()(const char *a, const char *b) const {
-    Slice sa = get_length_prefixed_slice(a);
-    Slice sb = get_length_prefixed_slice(b);
-    return comparator.compare(sa, sb);
+MemTable::MemTable(const InternalKeyComparator &cmp, const MemTableOptions &options)
+    : comparator(cmp),
+      arena(options.arena_block_size, options.arena_max_block_size, options.huge_page_size, options.block_pool,
+            options.write_buffer_manager),
+      table(options.rep_factory != nullptr ? options.rep_factory->create(comparator, &arena)
+                                           : default_rep_factory()->create(comparator, &arena)),
+      bloom(options.bloom_bits > 0 ? new DynamicBloom(&arena, options.bloom_bits, options.bloom_probes) : nullptr),
+      bloom_prefix_length(options.bloom_prefix_length),
+      merge_operator(options.merge_operator),
+      num_inplace_locks(options.inplace_update_num_locks),
+      inplace_locks(options.inplace_update_support && table->supports_inplace_update()
+                    ? new std::shared_mutex[options.inplace_update_num_locks] : nullptr),
+      write_buffer_manager(options.write_buffer_manager),
+      range_del_table(default_rep_factory()->create(comparator, &arena)),
+      num_range_dels(0),
+      frozen_table(nullptr),
+      refs(0) {}
+
+// sequence number in the trailer of an internal key
+static SeqNum seq_of(const Slice &internal_key) {
+    return decode_fixed_64(internal_key.data() + internal_key.size() - 8) >> 8;
 }
 
 // internal memtable iterator implementation for MemTable::new_iterator()
 class MemTableIterator: public Iterator{
 public:
-    explicit MemTableIterator(MemTable::Table *table): iter(table) {}
+    // skips entries covered by tombstones visible at read_seq, unless tombstones is null.
+    // if mem is not null, its entries may be updated in place while read
+    MemTableIterator(MemTableRep *table, std::shared_ptr<const FragmentedRangeTombstones> tombstones, SeqNum read_seq,
+                     MemTable *mem = nullptr)
+        : iter(table->new_iterator()), tombstones(std::move(tombstones)), read_seq(read_seq), mem(mem) {}
     MemTableIterator(const MemTableIterator&) = delete;
-    ~MemTableIterator() override = default;
+    ~MemTableIterator() override { delete iter; }
     MemTableIterator &operator=(const MemTableIterator &) = delete;
     // implements interface Iterator
-    bool valid() const override { return iter.valid(); }
-    void seek_to_first() override { iter.seek_to_first(); }
-    void seek_to_last() override { iter.seek_to_last(); }
-    void seek(const Slice &key) override { iter.seek(encode_key(&spirit, key)); }
-    void next() override { iter.next(); }
-    void prev() override { iter.prev(); }
-    Slice key() override { return get_length_prefixed_slice(iter.key()); }
+    bool valid() const override { return iter->valid(); }
+    void seek_to_first() override {
+        iter->seek_to_first();
+        skip_deleted(true);
+    }
+    void seek_to_last() override {
+        iter->seek_to_last();
+        skip_deleted(false);
+    }
+    void seek(const Slice &key) override {
+        {   // the rep compares tags of entries with the user key of key only
+            std::shared_lock<std::shared_mutex> lock = lock_key(extract_user_key(key));
+            iter->seek(encode_key(&spirit, key));
+        }
+        skip_deleted(true);
+    }
+    void next() override {
+        {
+            std::shared_lock<std::shared_mutex> lock = lock_key(extract_user_key(key()));
+            iter->next();
+        }
+        skip_deleted(true);
+    }
+    void prev() override {
+        {   // the rep may compare the entry with itself to find the one before
+            std::shared_lock<std::shared_mutex> lock = lock_key(extract_user_key(key()));
+            iter->prev();
+        }
+        skip_deleted(false);
+    }
+    Slice key() override { return get_length_prefixed_slice(entry()); }
     Slice value() override {    // remember the format: key_slice|val_slice
-        Slice key_slice = get_length_prefixed_slice(iter.key());
+        Slice key_slice = get_length_prefixed_slice(entry());
         return get_length_prefixed_slice(key_slice.data() + key_slice.size());
     }
     Status status() const override { return Status::OK(); }
 
 private:
-    // iter.seek() ultimately uses MemTable::KeyComparator which takes 
+    // the entry at iter, or the copy of it taken under its key's lock if mem is not null
+    const char *entry() const { return mem != nullptr ? entry_copy.data() : iter->key(); }
+    // lock against updates in place of entries of user_key, if mem may make them
+    std::shared_lock<std::shared_mutex> lock_key(const Slice &user_key) const {
+        if (mem == nullptr) return std::shared_lock<std::shared_mutex>();
+        return std::shared_lock<std::shared_mutex>(mem->inplace_lock(user_key));
+    }
+    // move on while the entry is deleted by a range tombstone newer than it. if mem is not
+    // null, copy the entry stopped at, so it isn't read half rewritten later
+    void skip_deleted(bool forward) {
+        while (iter->valid()) {
+            Slice internal_key = get_length_prefixed_slice(iter->key());
+            std::shared_lock<std::shared_mutex> lock = lock_key(extract_user_key(internal_key));
+            if (tombstones == nullptr
+                    || seq_of(internal_key) >= tombstones->max_covering_seq(extract_user_key(internal_key), read_seq)) {
+                if (mem != nullptr) {
+                    Slice value = get_length_prefixed_slice(internal_key.data() + internal_key.size());
+                    entry_copy.assign(iter->key(), value.data() + value.size() - iter->key());
+                }
+                break;
+            }
+            forward ? iter->next() : iter->prev();
+        }
+    }
+    // iter->seek() ultimately uses MemTable::KeyComparator which takes 
     // a memtable key. so here we encode the internal key to memtable key
     const char *encode_key(std::string *spirit, const Slice& target) {
         spirit->clear();
@@ -48,23 +115,219 @@ private:
         return spirit->data();
     }
 
-    MemTable::Table::Iterator iter; // = SkipList::Iterator
+    MemTableRep::Iterator *const iter;
+    const std::shared_ptr<const FragmentedRangeTombstones> tombstones;
+    const SeqNum read_seq;
+    MemTable *const mem;            // not null if entries may be updated in place
     std::string spirit;             // for passing to encode_key()
+    std::string entry_copy;         // the entry at iter, if mem is not null
 };
 
+// wraps MemTableIterator to collapse the merge operands of each user key visible at read_seq.
+// a run of operands is merged with the value or deletion below it into one VALUE entry, or
+// folded by partial merges into one MERGE entry if nothing is below it. other entries,
+// including older versions, are passed through. entries of a user key are buffered as a group
+class MergingMemTableIterator: public Iterator {
+public:
+    MergingMemTableIterator(MemTableRep *table, std::shared_ptr<const FragmentedRangeTombstones> tombstones,
+                            SeqNum read_seq, const MergeOperator *merge_operator, const Comparator *user_comparator,
+                            MemTable *mem)
+        : iter(table, tombstones, read_seq, mem), tombstones(tombstones), read_seq(read_seq),
+          merge_operator(merge_operator), user_comparator(user_comparator), pos(0), forward(true) {}
+    // implements interface Iterator
+    bool valid() const override { return pos < entries.size(); }
+    void seek_to_first() override {
+        iter.seek_to_first();
+        load_forward();
+    }
+    void seek_to_last() override {
+        iter.seek_to_last();
+        load_backward();
+    }
+    void seek(const Slice &key) override {
+        iter.seek(key);
+        load_forward();
+    }
+    void next() override {
+        assert(valid());
+        if (++ pos < entries.size()) return;
+        if (!forward) {     // iter is before the group, move it past
+            iter.seek(group_first);
+            while (iter.valid() && same_user_key(iter.key(), group_first)) iter.next();
+        }
+        load_forward();
+    }
+    void prev() override {
+        assert(valid());
+        if (pos > 0) {
+            pos --;
+            return;
+        }
+        if (forward) {      // iter is after the group, move it before
+            iter.seek(group_first);
+            if (iter.valid()) iter.prev();
+        }
+        load_backward();
+    }
+    Slice key() override { return entries[pos].first; }
+    Slice value() override { return entries[pos].second; }
+    Status status() const override { return s; }
+
+private:
+    bool same_user_key(const Slice &a, const Slice &b) const {
+        return user_comparator->compare(extract_user_key(a), extract_user_key(b)) == 0;
+    }
+    // buffer the group iter is at, leaving iter at the next group
+    void load_forward() {
+        entries.clear();
+        pos = 0;
+        forward = true;
+        if (!iter.valid()) return;
+        group_first = iter.key().to_string();
+        while (iter.valid() && same_user_key(iter.key(), group_first)) {
+            entries.emplace_back(iter.key().to_string(), iter.value().to_string());
+            iter.next();
+        }
+        collapse();
+    }
+    // buffer the group iter is at the last entry of, leaving iter at the previous group
+    void load_backward() {
+        entries.clear();
+        pos = 0;
+        forward = false;
+        if (!iter.valid()) return;
+        std::string group_last = iter.key().to_string();
+        while (iter.valid() && same_user_key(iter.key(), group_last)) {
+            entries.emplace_back(iter.key().to_string(), iter.value().to_string());
+            iter.prev();
+        }
+        std::reverse(entries.begin(), entries.end());
+        group_first = entries.front().first;
+        collapse();
+        pos = entries.size() - 1;
+    }
+    // replace the newest run of visible operands in entries with its merge result
+    void collapse() {
+        ParsedInternalKey ikey;
+        size_t begin = 0;   // skip entries newer than read_seq
+        while (begin < entries.size() && parse_internal_key(entries[begin].first, &ikey) && ikey.seq > read_seq) {
+            begin ++;
+        }
+        size_t end = begin;
+        while (end < entries.size() && parse_internal_key(entries[end].first, &ikey) && ikey.type == ValType::MERGE) {
+            end ++;
+        }
+        if (end == begin) return;
+
+        Slice user_key = extract_user_key(entries[begin].first);
+        std::vector<Slice> operands;    // oldest first
+        for (size_t i = end; i > begin; i --) {
+            operands.push_back(entries[i - 1].second);
+        }
+        std::string result;
+        ValType type = ValType::VALUE;
+        if (end < entries.size()) {     // on top of a value or deletion
+            Slice base = entries[end].second;
+            bool has_base = parse_internal_key(entries[end].first, &ikey) && ikey.type == ValType::VALUE;
+            if (!merge_operator->full_merge(user_key, has_base ? &base : nullptr, operands, &result)) {
+                s = Status::Corruption("merge operator failed");
+                return;
+            }
+        } else if (tombstones != nullptr && tombstones->max_covering_seq(user_key, read_seq) > 0) {
+            // entries below the run are deleted by a range tombstone, which is older than the run
+            if (!merge_operator->full_merge(user_key, nullptr, operands, &result)) {
+                s = Status::Corruption("merge operator failed");
+                return;
+            }
+        } else {    // an older memtable or table may hold the value, so fold operands if possible
+            type = ValType::MERGE;
+            result = operands[0].to_string();
+            std::string merged;
+            for (size_t i = 1; i < operands.size(); i ++) {
+                if (!merge_operator->partial_merge(user_key, result, operands[i], &merged)) return;
+                result.swap(merged);
+            }
+        }
+        parse_internal_key(entries[begin].first, &ikey);
+        std::string key;
+        append_internal_key(&key, ParsedInternalKey(ikey.user_key, ikey.seq, type));
+        entries[begin] = std::make_pair(key, result);
+        entries.erase(entries.begin() + begin + 1, entries.begin() + end);
+    }
+
+    MemTableIterator iter;
+    const std::shared_ptr<const FragmentedRangeTombstones> tombstones;
+    const SeqNum read_seq;
+    const MergeOperator *const merge_operator;
+    const Comparator *const user_comparator;
+    std::vector<std::pair<std::string, std::string>> entries;   // the current group, internal key | value
+    size_t pos;
+    bool forward;               // whether iter was last moved forward, so it's past the group
+    std::string group_first;    // internal key of the first raw entry of the group
+    Status s;
+};
+
+Iterator *MemTable::new_iterator(SeqNum read_seq) {
+    // no writes once frozen, so no updates in place either
+    MemTable *mem = inplace_locks != nullptr && !is_frozen() ? this : nullptr;
+    if (merge_operator != nullptr) {
+        return new MergingMemTableIterator(read_table(), get_range_tombstones(), read_seq, merge_operator,
+                                           comparator.comparator.user_comparator(), mem);
+    }
+    return new MemTableIterator(read_table(), get_range_tombstones(), read_seq, mem);
+}
+
+Iterator *MemTable::new_range_del_iterator() {
+    return new MemTableIterator(range_del_table, nullptr, MAX_SEQ_NUM);
+}
+
+std::shared_ptr<const FragmentedRangeTombstones> MemTable::get_range_tombstones() {
+    size_t count = num_range_dels.load(std::memory_order_acquire);
+    if (count == 0) return nullptr;
+
+    std::shared_ptr<const RangeTombstoneCache> cache = std::atomic_load(&range_tombstones);
+    if (cache != nullptr && cache->count >= count) {
+        return cache->tombstones;
+    }
+
+    // rebuild when tombstones were added since. those added during the rebuild may be
+    // included already, and only cost another rebuild
+    std::lock_guard<std::mutex> lock(range_del_mutex);
+    cache = std::atomic_load(&range_tombstones);
+    if (cache != nullptr && cache->count >= count) {    // rebuilt while waiting
+        return cache->tombstones;
+    }
+    std::vector<RangeTombstone> tombstones;
+    MemTableIterator iter(range_del_table, nullptr, MAX_SEQ_NUM);
+    for (iter.seek_to_first(); iter.valid(); iter.next()) {
+        Slice internal_key = iter.key();
+        tombstones.emplace_back(extract_user_key(internal_key), iter.value(), seq_of(internal_key));
+    }
+    auto fresh = std::make_shared<RangeTombstoneCache>();
+    fresh->tombstones = std::make_shared<const FragmentedRangeTombstones>(
+        tombstones, comparator.comparator.user_comparator());
+    fresh->count = count;
+    std::shared_ptr<const FragmentedRangeTombstones> result = fresh->tombstones;
+    std::atomic_store(&range_tombstones, std::shared_ptr<const RangeTombstoneCache>(std::move(fresh)));
+    return result;
+}
+
 // Format of an entry is concatenation of:
 //  key_size     : varint32 of internal_key.size()
 //  key bytes    : char[internal_key.size()]
 //  value_size   : varint32 of value.size()
 //  value bytes  : char[value.size()]
-void MemTable::add(SeqNum seq, ValType type, const Slice &key, const Slice &value) {
+size_t MemTable::encoded_length(const Slice &key, const Slice &value) {
+    size_t internal_key_size = key.size() + 8;
+    return varint_length(internal_key_size) + internal_key_size
+         + varint_length(value.size()) + value.size();
+}
+
+void MemTable::encode_entry(char *buf, SeqNum seq, ValType type, const Slice &key, const Slice &value) {
     size_t key_size = key.size();
     size_t val_size = value.size();
     size_t internal_key_size = key_size + 8;
-    size_t encoded_len = varint_length(internal_key_size) + internal_key_size
-                       + varint_length(val_size) + val_size;
 
-    char *buf = arena.allocate(encoded_len);
     char *p = encode_varint_32(buf, internal_key_size);
     std::memcpy(p, key.data(), key_size);
     p += key.size();
@@ -73,49 +336,275 @@ void MemTable::add(SeqNum seq, ValType type, const Slice &key, const Slice &valu
     p = encode_varint_32(p, val_size);
     std::memcpy(p, value.data(), val_size);
 
-    assert(p + val_size == buf + encoded_len);
+    assert(p + val_size == buf + encoded_length(key, value));
+}
+
+void MemTable::freeze() {
+    std::lock_guard<std::mutex> lock(freeze_mutex);
+    if (frozen_table.load(std::memory_order_relaxed) != nullptr) return;
+    frozen_table.store(new_flat_rep(comparator, table), std::memory_order_release);
+}
+
+void MemTable::insert(SeqNum seq, ValType type, const Slice &key, const Slice &value, bool concurrent) {
+    assert(!is_frozen());
+    size_t size = encoded_length(key, value);
+    char *buf = concurrent ? arena.allocate_concurrently(size) : arena.allocate(size);
+    encode_entry(buf, seq, type, key, value);
+    if (type == ValType::RANGE_DELETION) {
+        concurrent ? range_del_table->insert_concurrently(buf) : range_del_table->insert(buf);
+        num_range_dels.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    if (bloom != nullptr) {
+        concurrent ? bloom->add_concurrently(bloom_key(key)) : bloom->add(bloom_key(key));
+    }
+    concurrent ? table->insert_concurrently(buf) : table->insert(buf);
+}
+
+// state passed through MemTableRep::get() to save_newest()
+struct NewestEntry {
+    const Comparator *user_comparator;
+    const Slice *user_key;
+    const char *entry;      // null if the key has no entry
+    bool has_older;         // the key has another entry after entry
+};
+
+static bool save_newest(void *arg, const char *entry) {
+    NewestEntry *newest = reinterpret_cast<NewestEntry *>(arg);
+    if (newest->user_comparator->compare(extract_user_key(get_length_prefixed_slice(entry)), *newest->user_key) != 0) {
+        return false;
+    }
+    if (newest->entry == nullptr) {
+        newest->entry = entry;
+        return true;    // see if an older entry follows
+    }
+    newest->has_older = true;
+    return false;
+}
+
+bool MemTable::update_inplace(SeqNum seq, const Slice &key, const Slice &value) {
+    LookupKey lookup_key(key, seq);
+    NewestEntry newest = {comparator.comparator.user_comparator(), &key, nullptr, false};
+    table->get(lookup_key.memtable_key().data(), &newest, save_newest);
+    // with an older entry, a snapshot between the two would see a value it never could have
+    if (newest.entry == nullptr || newest.has_older) return false;
+
+    Slice internal_key = get_length_prefixed_slice(newest.entry);
+    char *tag = const_cast<char *>(internal_key.data() + internal_key.size() - 8);
+    if (static_cast<ValType>(decode_fixed_64(tag) & 0xff) != ValType::VALUE) return false;
+    Slice old_value = get_length_prefixed_slice(tag + 8);
+    // only the same size, so the value length that lock-free readers decode never changes
+    if (value.size() != old_value.size()) return false;
+
+    // the entry stays the only one of its key, so a larger seq keeps it in order
+    encode_fixed_64(tag, seq << 8 | static_cast<int>(ValType::VALUE));
+    std::memcpy(const_cast<char *>(old_value.data()), value.data(), value.size());
+    return true;
+}
+
+void MemTable::add_entry(SeqNum seq, ValType type, const Slice &key, const Slice &value, bool concurrent) {
+    if (inplace_locks != nullptr && type != ValType::RANGE_DELETION) {
+        // lock for other types too, so an update in place doesn't race with a newer entry
+        std::lock_guard<std::shared_mutex> lock(inplace_lock(key));
+        if (type != ValType::VALUE || !update_inplace(seq, key, value)) {
+            insert(seq, type, key, value, concurrent);
+        }
+    } else {
+        insert(seq, type, key, value, concurrent);
+    }
+    // outside the lock, as the manager calls into memtable owners
+    if (write_buffer_manager != nullptr && write_buffer_manager->should_flush()) {
+        write_buffer_manager->maybe_flush();
+    }
+}
+// state passed through MemTableRep::get() to save_value()
+struct Saver {
+    const MemTableKeyComparator *comparator;
+    Slice user_key;
+    std::string *value;
+    Status *s;
+    bool found;
+    SeqNum tombstone_seq;   // of the newest visible range tombstone covering key, or 0
+    const MergeOperator *merge_operator;
+    std::vector<std::string> *operands;     // collected merge operands, newest first
+};
 
-    table.insert(buf);
+// apply the collected operands to base, or to no value if null, ending the lookup
+static void merge_operands(Saver *saver, const Slice *base) {
+    saver->found = true;
+    if (saver->merge_operator == nullptr) {
+        *saver->s = Status::NotSupported("merge operator not set");
+        return;
+    }
+    std::vector<Slice> operands(saver->operands->rbegin(), saver->operands->rend());
+    if (saver->merge_operator->full_merge(saver->user_key, base, operands, saver->value)) {
+        *saver->s = Status::OK();
+    } else {
+        *saver->s = Status::Corruption("merge operator failed");
+    }
+    saver->operands->clear();
 }
+
 // entry format:
 //    key_len  varint32
 //    userkey  char[key_len]
 //    seqtype  uint64
 //    val_len  varint32
 //    value    char[val_len]
-// If valid, check it belongs to same user key.  We do not check the
-// sequence number since the Seek() call above should have skipped
-// all entries with overly large sequence numbers.
-bool MemTable::get(const LookupKey &key, std::string *value, Status *s) {
-    Slice mem_key = key.memtable_key();
-    
-    Table::Iterator iter(&table);
-    iter.seek(mem_key.data());
-
-    if (iter.valid()) {
-        const char *entry = iter.key();
-        uint32_t key_len;
-        const char *key_ptr = get_varint_32_ptr(entry, entry + 5, &key_len);
-        // invoke user-defined comparator to compare user keys
-        if (comparator.comparator.user_comparator()->compare(
-                Slice(key_ptr, key_len - 8), key.user_key()) == 0) {
-
-            // if same user key, check type
-            uint64_t seq_type = decode_fixed_64(key_ptr + key_len - 8);
-            Slice val;  // cannot define it under case label !!
-
-            switch(static_cast<ValType>(seq_type && 0xff)) {
-            case ValType::VALUE:
-                val = get_length_prefixed_slice(key_ptr + key_len);
-                value->assign(val.data(), val.size());
-                return true;
-            case ValType::DELETION:
-                *s = Status::NotFound(Slice());
-                return true;
+// Check the first entry belongs to same user key.  We do not check the
+// sequence number since the rep should have skipped all entries with
+// overly large sequence numbers.
+static bool save_value(void *arg, const char *entry) {
+    Saver *saver = reinterpret_cast<Saver *>(arg);
+    uint32_t key_len;
+    const char *key_ptr = get_varint_32_ptr(entry, entry + 5, &key_len);
+    // invoke user-defined comparator to compare user keys
+    if (saver->comparator->comparator.user_comparator()->compare(
+            Slice(key_ptr, key_len - 8), saver->user_key) == 0) {
+
+        // if same user key, check type
+        uint64_t seq_type = decode_fixed_64(key_ptr + key_len - 8);
+        Slice val;  // cannot define it under case label !!
+
+        bool merging = !saver->operands->empty();
+        if ((seq_type >> 8) < saver->tombstone_seq) {
+            if (merging) {
+                merge_operands(saver, nullptr);
+            } else {
+                *saver->s = Status::NotFound(Slice());
+                saver->found = true;
+            }
+            return false;
+        }
+        switch(static_cast<ValType>(seq_type & 0xff)) {
+        case ValType::VALUE:
+            val = get_length_prefixed_slice(key_ptr + key_len);
+            if (merging) {
+                merge_operands(saver, &val);
+            } else {
+                saver->value->assign(val.data(), val.size());
+                saver->found = true;
             }
+            break;
+        case ValType::DELETION:
+            if (merging) {
+                merge_operands(saver, nullptr);
+            } else {
+                *saver->s = Status::NotFound(Slice());
+                saver->found = true;
+            }
+            break;
+        case ValType::MERGE:
+            if (saver->merge_operator == nullptr) {
+                *saver->s = Status::NotSupported("merge operator not set");
+                saver->found = true;
+                break;
+            }
+            val = get_length_prefixed_slice(key_ptr + key_len);
+            saver->operands->push_back(val.to_string());
+            return true;    // go on to older entries of the key
+        case ValType::RANGE_DELETION:   // kept in range_del_table
+            assert(false);
+            break;
+        }
+    }
+    return false;   // only the newest entry matters, unless it's a merge operand
+}
+
+// end a lookup after the rep was searched. return what get() returns
+static bool finish_get(Saver *saver, bool has_merge_context) {
+    if (saver->found) return true;
+    if (saver->tombstone_seq > 0) {     // older entries only deleted by range
+        if (!saver->operands->empty()) {
+            merge_operands(saver, nullptr);
+        } else {
+            *saver->s = Status::NotFound(Slice());
         }
+        return true;
+    }
+    if (!saver->operands->empty() && !has_merge_context) {
+        merge_operands(saver, nullptr);
+        return true;
     }
     return false;
 }
 
+bool MemTable::get(const LookupKey &key, std::string *value, Status *s, MergeContext *merge_context) {
+    SeqNum tombstone_seq = 0;
+    std::shared_ptr<const FragmentedRangeTombstones> tombstones = get_range_tombstones();
+    if (tombstones != nullptr) {
+        tombstone_seq = tombstones->max_covering_seq(key.user_key(), seq_of(key.internal_key()));
+    }
+    std::vector<std::string> operands;
+    Saver saver = {&comparator, key.user_key(), value, s, false, tombstone_seq, merge_operator,
+                   merge_context != nullptr ? &merge_context->operands : &operands};
+    if (tombstone_seq > 0 || bloom == nullptr || bloom->may_contain(bloom_key(key.user_key()))) {
+        if (inplace_locks != nullptr) {
+            std::shared_lock<std::shared_mutex> lock(inplace_lock(key.user_key()));
+            read_table()->get(key.memtable_key().data(), &saver, save_value);
+        } else {
+            read_table()->get(key.memtable_key().data(), &saver, save_value);
+        }
+    }
+    return finish_get(&saver, merge_context != nullptr);
+}
+
+void MemTable::multi_get(size_t n, const Slice *keys, SeqNum seq, std::string *values, Status *statuses,
+                         bool *found, MergeContext *merge_contexts) {
+    // search in key order, so the rep can move on from where the last key was found
+    const Comparator *user_comparator = comparator.comparator.user_comparator();
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i ++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return user_comparator->compare(keys[a], keys[b]) < 0;
+    });
+
+    // memtable keys of all lookups in one buffer, rather than a LookupKey each
+    size_t total_size = 0;
+    for (size_t i = 0; i < n; i ++) {
+        total_size += varint_length(keys[i].size() + 8) + keys[i].size() + 8;
+    }
+    std::string buf;
+    buf.reserve(total_size);
+    std::vector<size_t> offsets(n);
+    for (size_t i = 0; i < n; i ++) {
+        const Slice &key = keys[order[i]];
+        offsets[i] = buf.size();
+        append_varint_32(&buf, key.size() + 8);
+        buf.append(key.data(), key.size());
+        append_fixed_64(&buf, seq << 8 | static_cast<int>(ValType::SEEK));
+    }
+
+    std::shared_ptr<const FragmentedRangeTombstones> tombstones = get_range_tombstones();
+    std::vector<std::vector<std::string>> operands(merge_contexts != nullptr ? 0 : n);
+    std::vector<Saver> savers(n);
+    std::vector<const char *> search_keys;
+    std::vector<void *> search_args;
+    search_keys.reserve(n);
+    search_args.reserve(n);
+    for (size_t i = 0; i < n; i ++) {
+        size_t k = order[i];
+        SeqNum tombstone_seq = tombstones != nullptr ? tombstones->max_covering_seq(keys[k], seq) : 0;
+        savers[i] = {&comparator, keys[k], &values[k], &statuses[k], false, tombstone_seq, merge_operator,
+                     merge_contexts != nullptr ? &merge_contexts[k].operands : &operands[k]};
+        if (tombstone_seq > 0 || bloom == nullptr || bloom->may_contain(bloom_key(keys[k]))) {
+            search_keys.push_back(buf.data() + offsets[i]);
+            search_args.push_back(&savers[i]);
+        }
+    }
+    MemTableRep *rep = read_table();
+    if (inplace_locks != nullptr) {     // lock key by key
+        for (size_t i = 0; i < search_keys.size(); i ++) {
+            Saver *saver = reinterpret_cast<Saver *>(search_args[i]);
+            std::shared_lock<std::shared_mutex> lock(inplace_lock(saver->user_key));
+            rep->get(search_keys[i], saver, save_value);
+        }
+    } else {
+        rep->multi_get(search_keys.size(), search_keys.data(), search_args.data(), save_value);
+    }
+    for (size_t i = 0; i < n; i ++) {
+        found[order[i]] = finish_get(&savers[i], merge_contexts != nullptr);
+    }
+}
+
 } // namespace stackdb
\ No newline at end of file
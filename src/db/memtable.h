@@ -1,62 +1,211 @@
 #ifndef STACKDB_MEMTABLE_H
 #define STACKDB_MEMTABLE_H
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtable_rep.h"
+#include "db/range_tombstone.h"
+#include "db/write_buffer_manager.h"
 #include "stackdb/iterator.h"
-#include "util/arena.h"
+#include "stackdb/merge_operator.h"
+#include "util/concurrent_arena.h"
+#include "util/dynamic_bloom.h"
+#include "util/hash.h"
 
 namespace stackdb {
+    struct MemTableOptions {
+        // creates the rep that orders entries. a skiplist if null
+        const MemTableRepFactory *rep_factory = nullptr;
+        // size of a bloom filter over added user keys, which get() checks before searching
+        // the rep. charged to the memtable arena. 0 disables the filter
+        uint32_t bloom_bits = 0;
+        int bloom_probes = 6;
+        // if nonzero the filter holds only the first bloom_prefix_length bytes of each user
+        // key (prefix mode), else whole user keys
+        size_t bloom_prefix_length = 0;
+        // arena blocks start at arena_block_size and double up to arena_max_block_size, so a
+        // large memtable makes fewer, larger allocations. no growth by default
+        size_t arena_block_size = Arena::BLOCK_SIZE;
+        size_t arena_max_block_size = 0;
+        // if nonzero, arena blocks are rounded up to this size and backed by huge pages when
+        // the system has them, for fewer TLB misses on reads. e.g. 2MB on x86-64
+        size_t huge_page_size = 0;
+        // if not null, arena blocks are recycled through this pool across memtables. shared by
+        // the memtables of a DB, and must outlive them
+        ArenaBlockPool *block_pool = nullptr;
+        // combines MERGE entries with older values in get() and iterators. MERGE entries
+        // can't be read without it. must outlive the memtable
+        const MergeOperator *merge_operator = nullptr;
+        // if true, a VALUE for a key whose only entry in the memtable is a VALUE of the same
+        // size overwrites that entry in place instead of adding one, so overwritten counters
+        // and flags don't fill the memtable. the old value is lost: a snapshot taken between
+        // the two writes finds no entry for the key here, and reads it from older memtables
+        // or tables. writes and reads of a key serialize on one of inplace_update_num_locks
+        // locks. iterators take it to copy each entry they stop at, so no read sees an entry
+        // half rewritten. ignored for reps that keep their own copy of keys, like the ART rep
+        bool inplace_update_support = false;
+        size_t inplace_update_num_locks = 1024;
+        // if not null, the arena is charged to this manager, and writes that take it over
+        // budget ask it to flush memtables. shared by memtables across DBs, and must outlive them
+        WriteBufferManager *write_buffer_manager = nullptr;
+    };
+
+    // merge operands of a key collected by MemTable::get() that are still to be applied to
+    // a value in an older memtable or table
+    struct MergeContext {
+        std::vector<std::string> operands;  // newest first
+    };
+
     // MemTables are reference counted. init ref is 0 so caller must call ref() at least once.
     //                                                  memtable key | memtable value
     //
     //               varint size | user key | type | sequence num                       varint size | value
     // memtable key:          11 | "abc"    | 1    | 1234567            memtable value:           3 | "yes"
+    //
+    // entries are kept in order by a MemTableRep created from options.rep_factory. range
+    // tombstones are kept apart in their own rep, keyed by begin key with end key as value.
     class MemTable {
     public:
-        explicit MemTable(const InternalKeyComparator &cmp)
-            : comparator(cmp), table(cmp, &arena), refs(0) {}
+        explicit MemTable(const InternalKeyComparator &cmp, const MemTableOptions &options = MemTableOptions());
         MemTable(const MemTable &) = delete;
         MemTable& operator=(const MemTable&) = delete;
 
-        // reference counting
-        void ref() { ++ refs; }
+        // reference counting. atomic, so a WriteBufferManager may hold a ref from another thread
+        void ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+        // ref() unless the last ref is gone and the memtable is being destroyed
+        bool try_ref() {
+            int n = refs.load(std::memory_order_relaxed);
+            while (n > 0 && !refs.compare_exchange_weak(n, n + 1, std::memory_order_relaxed)) {}
+            return n > 0;
+        }
         void unref() {
-            -- refs;
-            assert(refs >= 0);
-            if (refs <= 0){
+            int n = refs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+            assert(n >= 0);
+            if (n <= 0){
                 delete this;    // MemTable objects are allocated in free store, so delete ptr to it             
             }
         }
         // approximate memory usage in bytes
-        size_t approxi_mem_usage() { return arena.get_mem_usage(); }
+        size_t approxi_mem_usage() {
+            MemTableRep *frozen = frozen_table.load(std::memory_order_acquire);
+            return arena.get_mem_usage() + table->approxi_mem_usage() + range_del_table->approxi_mem_usage()
+                 + (frozen != nullptr ? frozen->approxi_mem_usage() : 0);
+        }
+        // how the memtable arena's memory is used, for tuning memtable and arena block sizes
+        ArenaStats get_arena_stats() const { return arena.get_stats(); }
         // iterator over the memtable. live while the memtable is live.
-        // key() returned by this iterator are internal keys encoded by append_internal_key()
-        Iterator *new_iterator();
+        // key() returned by this iterator are internal keys encoded by append_internal_key().
+        // entries deleted by range tombstones visible at read_seq are skipped
+        Iterator *new_iterator(SeqNum read_seq = MAX_SEQ_NUM);
+        // iterator over range tombstones. key() is the internal key of the begin key, and
+        // value() is the end key
+        Iterator *new_range_del_iterator();
         // add an entry into memtable that maps user_key to value at specified seq num.
-        // typically value will be empty if type == DELETETION
-        void add(SeqNum seq, ValType type, const Slice &key, const Slice &value);
+        // typically value will be empty if type == DELETETION.
+        // with options.inplace_update_support, a VALUE may update the key's entry in place
+        // if type == RANGE_DELETION, deletes user keys in [key, value) added before seq
+        void add(SeqNum seq, ValType type, const Slice &key, const Slice &value) {
+            add_entry(seq, type, key, value, false);
+        }
+        void delete_range(SeqNum seq, const Slice &begin, const Slice &end) {
+            add(seq, ValType::RANGE_DELETION, begin, end);
+        }
+        // add a merge operand for key, applied to its older value when read
+        void merge(SeqNum seq, const Slice &key, const Slice &operand) {
+            add(seq, ValType::MERGE, key, operand);
+        }
+        // same as add(), but may be called from many threads at the same time.
+        // don't mix with add() while concurrent writers are running
+        void add_concurrently(SeqNum seq, ValType type, const Slice &key, const Slice &value) {
+            add_entry(seq, type, key, value, true);
+        }
+        // copy entries into a sorted flat array that later reads search instead of the rep,
+        // for a memtable that takes no more writes, e.g. one waiting to be flushed. may run on
+        // a background thread while reads go on. iterators created before keep the rep
+        void freeze();
+        bool is_frozen() const { return frozen_table.load(std::memory_order_acquire) != nullptr; }
         // if contains a value for key, store it in *value and return true. 
-        // if contains a deletion for key, store a NotFound() error in *status and return true.
+        // if contains a deletion or range deletion for key, store a NotFound() error in *status and return true.
         // else return false.
-        bool get(const LookupKey &key, std::string *value, Status *s);
+        // merge operands newer than the value are applied to it, or to no value if deleted.
+        // if the memtable runs out of entries before a value or deletion, operands are left
+        // in *merge_context for the caller to resolve against older data, and false returned.
+        // without merge_context the memtable is the only source, and operands are applied to
+        // no value. operands already in *merge_context are newer than those in the memtable
+        bool get(const LookupKey &key, std::string *value, Status *s, MergeContext *merge_context = nullptr);
+        // get() for n user keys at snapshot seq, searched in one sorted pass over the rep.
+        // found[i], values[i] and statuses[i] are set like get() does for keys[i]. if
+        // merge_contexts is not null, it has a context for each key
+        void multi_get(size_t n, const Slice *keys, SeqNum seq, std::string *values, Status *statuses,
+                       bool *found, MergeContext *merge_contexts = nullptr);
 
         friend class MemTableIterator;
     private:
         // private deconstructor. so MemTable object can only be allocated on head, not on stack
-        ~MemTable() { assert(refs == 0); }
-        // wrapper for InternalKeyComparator, define operator()(a, b) since SkipList invokes compare(a, b)
-        struct KeyComparator {
-            KeyComparator(const InternalKeyComparator &cmp) : comparator(cmp) {} // BUG: remove 'explicit' or MemTable() won't compile
-            int operator()(const char *a, const char *b) const;
-            const InternalKeyComparator comparator;
-        };
-        typedef SkipList<const char *, KeyComparator> Table;
+        ~MemTable() {
+            assert(refs.load(std::memory_order_relaxed) == 0);
+            if (write_buffer_manager != nullptr) {
+                write_buffer_manager->remove_memtable(this);
+            }
+            delete bloom;
+            delete frozen_table.load(std::memory_order_relaxed);
+            delete range_del_table;
+            delete table;
+        }
+        // the rep reads go to, the flat array once frozen
+        MemTableRep *read_table() const {
+            MemTableRep *frozen = frozen_table.load(std::memory_order_acquire);
+            return frozen != nullptr ? frozen : table;
+        }
+        void add_entry(SeqNum seq, ValType type, const Slice &key, const Slice &value, bool concurrent);
+        // add() and add_concurrently() without in-place updates
+        void insert(SeqNum seq, ValType type, const Slice &key, const Slice &value, bool concurrent);
+        // overwrite the newest entry of key with seq and value, if it's a VALUE with room for
+        // value. requires the key's in-place lock
+        bool update_inplace(SeqNum seq, const Slice &key, const Slice &value);
+        std::shared_mutex &inplace_lock(const Slice &key) {
+            return inplace_locks[hash(key.data(), key.size(), 0) % num_inplace_locks];
+        }
+        // range tombstones added so far, fragmented. null if there are none
+        std::shared_ptr<const FragmentedRangeTombstones> get_range_tombstones();
+        // encode an entry into buf, which has room for encoded_length() bytes
+        static void encode_entry(char *buf, SeqNum seq, ValType type, const Slice &key, const Slice &value);
+        static size_t encoded_length(const Slice &key, const Slice &value);
+        // the part of user key held by the bloom filter
+        Slice bloom_key(const Slice &user_key) const {
+            return bloom_prefix_length == 0 ? user_key
+                                            : Slice(user_key.data(), std::min(user_key.size(), bloom_prefix_length));
+        }
+        typedef MemTableKeyComparator KeyComparator;
 
         KeyComparator comparator;
-        Arena arena;
-        Table table;
-        int refs;
+        ConcurrentArena arena;      // add_concurrently() allocates without a mutex
+        MemTableRep *const table;   // allocates from arena, so declared after it
+        DynamicBloom *const bloom;  // null if disabled
+        const size_t bloom_prefix_length;
+        const MergeOperator *const merge_operator;
+        const size_t num_inplace_locks;
+        std::unique_ptr<std::shared_mutex[]> inplace_locks;    // null unless in-place updates are on
+
+        WriteBufferManager *const write_buffer_manager;
+        MemTableRep *const range_del_table;
+        std::atomic<size_t> num_range_dels;
+        // fragments of the range tombstones, and num_range_dels when they were built
+        struct RangeTombstoneCache {
+            std::shared_ptr<const FragmentedRangeTombstones> tombstones;
+            size_t count;
+        };
+        // read and published with std::atomic_load() and std::atomic_store(), so readers of an
+        // up to date cache take no lock
+        std::shared_ptr<const RangeTombstoneCache> range_tombstones;
+        std::mutex range_del_mutex; // serializes rebuilds of range_tombstones
+        std::atomic<MemTableRep *> frozen_table;    // null until freeze()
+        std::mutex freeze_mutex;
+        std::atomic<int> refs;
     };
 }
 
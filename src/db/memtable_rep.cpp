@@ -0,0 +1,127 @@
+#include <algorithm>
+#include "db/memtable_rep.h"
+#include "db/skiplist.h"
+#include "util/coding.h"
+
+namespace stackdb {
+
+int MemTableKeyComparator::operator()(const char *a, const char *b) const {
+    Slice sa = get_length_prefixed_slice(a);
+    Slice sb = get_length_prefixed_slice(b);
+    return comparator.compare(sa, sb);
+}
+
+uint64_t MemTableKeyComparator::key_prefix(const char *entry) const {
+    Slice user_key = extract_user_key(get_length_prefixed_slice(entry));
+    size_t n = std::min(user_key.size(), sizeof(uint64_t));
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < n; i ++) {
+        prefix |= static_cast<uint64_t>(static_cast<uint8_t>(user_key[i])) << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+namespace {
+    // the default rep, backed by SkipList with back links for cheap prev(). Cmp is
+    // BytewiseMemTableKeyComparator when possible, so compares in the skiplist are inlined
+    template <typename Cmp>
+    class SkipListRep: public MemTableRep {
+    public:
+        SkipListRep(const Cmp &cmp, Arena *arena)
+            : table(cmp, arena, true) {}
+
+        void insert(const char *entry) override {
+            table.insert_with_hint(entry, &insert_hint);
+        }
+        void insert_concurrently(const char *entry) override {
+            table.insert_concurrently(entry);
+        }
+        void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) override {
+            typename Table::Iterator iter(&table);
+            for (iter.seek(key); iter.valid() && callback(arg, iter.key()); iter.next()) {}
+        }
+        // walks the list with one finger, so sorted keys near each other skip the descent from head
+        void multi_get(size_t n, const char *const *keys, void *const *args,
+                       bool (*callback)(void *arg, const char *entry)) override {
+            typename Table::Iterator iter(&table);
+            typename Table::Splice finger;
+            for (size_t i = 0; i < n; i ++) {
+                iter.seek(keys[i], &finger);
+                if (i + 1 < n) {    // the search for the next key loads these while callbacks run
+                    table.prefetch_from(finger);
+                }
+                for (; iter.valid() && callback(args[i], iter.key()); iter.next()) {}
+            }
+        }
+        MemTableRep::Iterator *new_iterator() override { return new Iterator(&table); }
+
+    private:
+        typedef SkipList<const char *, Cmp> Table;
+
+        class Iterator: public MemTableRep::Iterator {
+        public:
+            explicit Iterator(const Table *table): iter(table) {}
+            bool valid() const override { return iter.valid(); }
+            const char *key() const override { return iter.key(); }
+            void next() override { iter.next(); }
+            void prev() override { iter.prev(); }
+            void seek(const char *key) override { iter.seek(key); }
+            void seek_to_first() override { iter.seek_to_first(); }
+            void seek_to_last() override { iter.seek_to_last(); }
+        private:
+            typename Table::Iterator iter;
+        };
+
+        Table table;
+        typename Table::Splice insert_hint;  // path of the last insert(), so ascending keys skip the descent
+    };
+
+    class SkipListRepFactory: public MemTableRepFactory {
+    public:
+        const char *name() const override { return "stackdb.SkipListRep"; }
+        MemTableRep *create(const MemTableKeyComparator &cmp, Arena *arena) const override {
+            if (cmp.comparator.user_comparator() == bytewise_comparator()) {
+                return new SkipListRep<BytewiseMemTableKeyComparator>(BytewiseMemTableKeyComparator(cmp), arena);
+            }
+            return new SkipListRep<MemTableKeyComparator>(cmp, arena);
+        }
+    };
+
+    // iterates over a sorted vector of entries shared with its creator
+    class SnapshotIterator: public MemTableRep::Iterator {
+    public:
+        SnapshotIterator(const MemTableKeyComparator &cmp,
+                         std::shared_ptr<const std::vector<const char *>> entries)
+            : cmp(cmp), entries(std::move(entries)), pos(this->entries->size()) {}
+
+        bool valid() const override { return pos < entries->size(); }
+        const char *key() const override { assert(valid()); return (*entries)[pos]; }
+        void next() override { assert(valid()); pos ++; }
+        void prev() override {      // stepping back from the first entry invalidates
+            assert(valid());
+            pos = (pos == 0) ? entries->size() : pos - 1;
+        }
+        void seek(const char *key) override {
+            auto less = [this](const char *a, const char *b) { return cmp(a, b) < 0; };
+            pos = std::lower_bound(entries->begin(), entries->end(), key, less) - entries->begin();
+        }
+        void seek_to_first() override { pos = 0; }
+        void seek_to_last() override { pos = entries->empty() ? 0 : entries->size() - 1; }
+
+    private:
+        const MemTableKeyComparator cmp;
+        const std::shared_ptr<const std::vector<const char *>> entries;
+        size_t pos;     // entries->size() if not valid
+    };
+} // anonymous namespace
+
+MemTableRep::Iterator *new_snapshot_iterator(const MemTableKeyComparator &cmp,
+                                             std::shared_ptr<const std::vector<const char *>> entries) {
+    return new SnapshotIterator(cmp, std::move(entries));
+}
+
+MemTableRepFactory *new_skiplist_rep_factory() {
+    return new SkipListRepFactory();
+}
+
+} // namespace stackdb
@@ -0,0 +1,136 @@
+#ifndef STACKDB_MEMTABLE_REP_H
+#define STACKDB_MEMTABLE_REP_H
+
+#include <memory>
+#include <vector>
+#include "db/dbformat.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+// MemTableRep is the container that keeps memtable entries in order. MemTable encodes
+// entries into the arena and hands a pointer to the rep, which only orders them.
+// entries start with the memtable key, i.e. varint size | internal key.
+//
+// Like SkipList, writes to a rep require external synchronization unless done through
+// insert_concurrently(), while reads may run concurrently with a single writer.
+namespace stackdb {
+    // get slice representaion of internal key from memtable key
+    inline Slice get_length_prefixed_slice(const char *data) {
+        uint32_t size = static_cast<uint8_t>(*data);
+        if (size < 128) {   // one byte varint, for keys shorter than 120 bytes
+            return Slice(data + 1, size);
+        }
+        const char *p = get_varint_32_ptr(data, data + 5, &size);   // assume data is not corrupted
+        return Slice(p, size);
+    }
+
+    // wrapper for InternalKeyComparator, define operator()(a, b) since SkipList invokes compare(a, b)
+    struct MemTableKeyComparator {
+        MemTableKeyComparator(const InternalKeyComparator &cmp) : comparator(cmp) {} // BUG: remove 'explicit' or MemTable() won't compile
+        int operator()(const char *a, const char *b) const;
+        // inline key prefix for SkipList: first 8 bytes of the user key, big-endian and zero
+        // padded. orders like the user key only for the bytewise comparator
+        bool key_prefix_enabled() const { return comparator.user_comparator() == bytewise_comparator(); }
+        uint64_t key_prefix(const char *entry) const;
+        const InternalKeyComparator comparator;
+    };
+
+    // MemTableKeyComparator with the bytewise user comparator fixed at compile time, so keys
+    // compare with an inlined memcmp rather than two virtual calls. for reps that take the
+    // comparator as a template parameter, like SkipList
+    struct BytewiseMemTableKeyComparator: public MemTableKeyComparator {
+        explicit BytewiseMemTableKeyComparator(const MemTableKeyComparator &cmp): MemTableKeyComparator(cmp) {
+            assert(cmp.comparator.user_comparator() == bytewise_comparator());
+        }
+        int operator()(const char *a, const char *b) const {
+            return compare_internal_keys(BytewiseCompare(), get_length_prefixed_slice(a), get_length_prefixed_slice(b));
+        }
+        bool key_prefix_enabled() const { return true; }
+    };
+
+    class MemTableRep {
+    public:
+        class Iterator;
+
+        MemTableRep() = default;
+        MemTableRep(const MemTableRep &) = delete;
+        MemTableRep& operator=(const MemTableRep&) = delete;
+        virtual ~MemTableRep() = default;
+
+        // insert entry into the rep. no entry comparing equal may already be in the rep
+        virtual void insert(const char *entry) = 0;
+        // same as insert(), but safe with other concurrent insert_concurrently() calls
+        virtual void insert_concurrently(const char *entry) = 0;
+        // call callback(arg, entry) for entries at or after memtable key in order, until it
+        // returns false. only entries with the same user key as key are guaranteed to be visited
+        virtual void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) = 0;
+        // get() for n memtable keys, with args[i] passed to callback for keys[i]. reps that
+        // keep entries in order may search each key from where the last one was found, so
+        // keys are best sorted
+        virtual void multi_get(size_t n, const char *const *keys, void *const *args,
+                               bool (*callback)(void *arg, const char *entry)) {
+            for (size_t i = 0; i < n; i ++) {
+                get(keys[i], args[i], callback);
+            }
+        }
+        // iterator over all entries in order. caller takes ownership
+        virtual Iterator *new_iterator() = 0;
+        // memory held by the rep outside of the memtable arena
+        virtual size_t approxi_mem_usage() const { return 0; }
+        // false if the rep orders entries by a copy of their keys, so a sequence number
+        // rewritten in an entry would go unnoticed. see MemTableOptions::inplace_update_support
+        virtual bool supports_inplace_update() const { return true; }
+    };
+
+    // iterates over memtable keys. mirrors SkipList::Iterator
+    class MemTableRep::Iterator {
+    public:
+        Iterator() = default;
+        Iterator(const Iterator &) = delete;
+        Iterator& operator=(const Iterator&) = delete;
+        virtual ~Iterator() = default;
+
+        virtual bool valid() const = 0;
+        virtual const char *key() const = 0;            // requires valid()
+        virtual void next() = 0;                        // requires valid()
+        virtual void prev() = 0;                        // requires valid()
+        virtual void seek(const char *key) = 0;         // position at first entry >= memtable key
+        virtual void seek_to_first() = 0;
+        virtual void seek_to_last() = 0;
+    };
+
+    // iterator over a sorted, immutable snapshot of entries, for reps that don't keep entries
+    // in order themselves. entries must be sorted by cmp
+    MemTableRep::Iterator *new_snapshot_iterator(const MemTableKeyComparator &cmp,
+                                                 std::shared_ptr<const std::vector<const char *>> entries);
+
+    // read-only copy of the entries of source in a sorted array, for memtables that take no
+    // more writes. reads are binary searches over the array, without pointer chasing
+    MemTableRep *new_flat_rep(const MemTableKeyComparator &cmp, MemTableRep *source);
+
+    // creates a rep for each new memtable
+    class MemTableRepFactory {
+    public:
+        virtual ~MemTableRepFactory() = default;
+        virtual const char *name() const = 0;
+        // the rep allocates from arena, which outlives it
+        virtual MemTableRep *create(const MemTableKeyComparator &cmp, Arena *arena) const = 0;
+    };
+
+    // the default rep. a skiplist with ordered reads and writes in O(log n)
+    MemTableRepFactory *new_skiplist_rep_factory();
+    // entries hashed by the first prefix_length bytes of the user key into bucket_count small
+    // sorted lists. point lookups only walk one list, while a full iterator sorts all entries
+    // on creation. for point-lookup-heavy workloads. each memtable takes bucket_count pointers
+    // from its arena up front, so size bucket_count to the entries a memtable holds
+    MemTableRepFactory *new_hash_bucket_rep_factory(size_t bucket_count = 4096, size_t prefix_length = 8);
+    // entries appended to a vector and sorted when read. inserts are O(1), so it suits bulk
+    // loads that are read only once, at flush
+    MemTableRepFactory *new_vector_rep_factory();
+    // adaptive radix tree over the key bytes. lookups and seeks cost O(key length) rather than
+    // O(log n) full key compares, which pays off for long keys with shared prefixes. falls
+    // back to a skiplist unless the user comparator is bytewise
+    MemTableRepFactory *new_art_rep_factory();
+} // namespace stackdb
+
+#endif
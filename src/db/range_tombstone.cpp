@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <functional>
+#include <set>
+#include "db/range_tombstone.h"
+
+namespace stackdb {
+
+FragmentedRangeTombstones::FragmentedRangeTombstones(const std::vector<RangeTombstone> &tombstones,
+                                                     const Comparator *user_cmp)
+    : user_cmp(user_cmp) {
+    auto less = [user_cmp](const std::string &a, const std::string &b) { return user_cmp->compare(a, b) < 0; };
+
+    // every begin and end key is a fragment boundary
+    std::vector<std::string> bounds;
+    std::vector<const RangeTombstone *> sorted;
+    for (const RangeTombstone &t : tombstones) {
+        if (user_cmp->compare(t.begin, t.end) >= 0) continue;   // empty range
+        bounds.push_back(t.begin);
+        bounds.push_back(t.end);
+        sorted.push_back(&t);
+    }
+    std::sort(bounds.begin(), bounds.end(), less);
+    bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                             [user_cmp](const std::string &a, const std::string &b) { return user_cmp->compare(a, b) == 0; }),
+                 bounds.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [&less](const RangeTombstone *a, const RangeTombstone *b) { return less(a->begin, b->begin); });
+
+    // sweep the boundaries, keeping the tombstones that cover the current fragment by end key
+    struct EndLess {
+        const Comparator *user_cmp;
+        bool operator()(const RangeTombstone *a, const RangeTombstone *b) const {
+            return user_cmp->compare(a->end, b->end) < 0;
+        }
+    };
+    std::multiset<const RangeTombstone *, EndLess> active(EndLess{user_cmp});
+    size_t next = 0;
+    for (size_t i = 0; i + 1 < bounds.size(); i ++) {
+        while (!active.empty() && user_cmp->compare((*active.begin())->end, bounds[i]) <= 0) {
+            active.erase(active.begin());
+        }
+        while (next < sorted.size() && user_cmp->compare(sorted[next]->begin, bounds[i]) <= 0) {
+            active.insert(sorted[next]);
+            next ++;
+        }
+        if (active.empty()) continue;
+
+        Fragment fragment;
+        fragment.begin = bounds[i];
+        fragment.end = bounds[i + 1];
+        for (const RangeTombstone *t : active) {
+            fragment.seqs.push_back(t->seq);
+        }
+        std::sort(fragment.seqs.begin(), fragment.seqs.end(), std::greater<SeqNum>());
+        fragments.push_back(std::move(fragment));
+    }
+}
+
+SeqNum FragmentedRangeTombstones::max_covering_seq(const Slice &user_key, SeqNum read_seq) const {
+    // last fragment beginning at or before user_key
+    auto it = std::upper_bound(fragments.begin(), fragments.end(), user_key,
+                               [this](const Slice &key, const Fragment &f) { return user_cmp->compare(key, f.begin) < 0; });
+    if (it == fragments.begin()) return 0;
+    --it;
+    if (user_cmp->compare(user_key, it->end) >= 0) return 0;
+
+    // newest seq visible at read_seq
+    auto seq = std::lower_bound(it->seqs.begin(), it->seqs.end(), read_seq, std::greater<SeqNum>());
+    return seq == it->seqs.end() ? 0 : *seq;
+}
+
+} // namespace stackdb
@@ -0,0 +1,44 @@
+#ifndef STACKDB_RANGE_TOMBSTONE_H
+#define STACKDB_RANGE_TOMBSTONE_H
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+
+namespace stackdb {
+    // deletes user keys in [begin, end) with sequence numbers less than seq
+    struct RangeTombstone {
+        RangeTombstone(const Slice &begin, const Slice &end, SeqNum seq)
+            : begin(begin.to_string()), end(end.to_string()), seq(seq) {}
+
+        std::string begin;
+        std::string end;
+        SeqNum seq;
+    };
+
+    // range tombstones cut at every begin and end key into non-overlapping fragments, each with
+    // the sequence numbers of the tombstones covering it. finding the newest tombstone covering
+    // a key is then a binary search rather than a scan over possibly overlapping tombstones
+    class FragmentedRangeTombstones {
+    public:
+        FragmentedRangeTombstones(const std::vector<RangeTombstone> &tombstones, const Comparator *user_cmp);
+
+        // largest seq of the tombstones covering user_key that are visible at read_seq,
+        // i.e. seq <= read_seq. 0 if there is none
+        SeqNum max_covering_seq(const Slice &user_key, SeqNum read_seq = MAX_SEQ_NUM) const;
+        bool empty() const { return fragments.empty(); }
+        size_t num_fragments() const { return fragments.size(); }
+
+    private:
+        struct Fragment {
+            std::string begin;
+            std::string end;
+            std::vector<SeqNum> seqs;   // in decreasing order
+        };
+
+        const Comparator *const user_cmp;
+        std::vector<Fragment> fragments;    // ordered by begin, and don't overlap
+    };
+}
+
+#endif
@@ -2,13 +2,17 @@
 #define STACKDB_SKIPLIST_H
 
 #include <atomic>
+#include <thread>
+#include <type_traits>
 #include "util/arena.h"
 #include "util/random.h"
 
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes through insert() require external synchronization, most likely a mutex.
+// Writes through insert_concurrently() may run from many threads at the same
+// time, but must not be mixed with concurrent insert() calls.
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -23,9 +27,25 @@
 // immutable after the Node has been linked into the SkipList.
 // Only Insert() modifies the list, and it is careful to initialize
 // a node and use release-stores to publish the nodes in one or
-// more lists.
+// more lists. insert_concurrently() publishes with compare-and-swap
+// instead, so a racing writer at the same level is detected and retried.
 
 namespace stackdb {
+    // Key prefix
+    // ----------
+    //
+    // A Comparator may opt in to an inline key prefix by defining
+    //   bool key_prefix_enabled() const;
+    //   uint64_t key_prefix(const Key &key) const;
+    // where key_prefix(a) < key_prefix(b) must imply compare(a, b) < 0. If enabled,
+    // every node stores the prefix in front of it, and a search compares prefixes
+    // first so that most comparisons never touch the memory the key points to.
+    template<class Comparator, typename Key, typename = void>
+    struct has_key_prefix : std::false_type {};
+    template<class Comparator, typename Key>
+    struct has_key_prefix<Comparator, Key, std::void_t<decltype(
+        std::declval<const Comparator &>().key_prefix(std::declval<const Key &>()))>> : std::true_type {};
+
     // SkipList
     // New SkipList object will use "cmp" for comparing keys,
     // and will allocate memory using "*arena".  Objects allocated in the arena
@@ -34,15 +54,23 @@ namespace stackdb {
     class SkipList {
         private: struct Node;    // internal node that makes up the list        
         public:  class Iterator; // class that iterates over contents of a skip list.
+        public:  struct Splice;  // cached search path of the last insert, as insert hint
 
     public:
-        explicit SkipList(Comparator cmp, Arena *arena);
+        // if backward_link is true, every node also keeps a level-0 link to its predecessor,
+        // so Iterator::prev() is a pointer load instead of a search from head
+        explicit SkipList(Comparator cmp, Arena *arena, bool backward_link = false);
         SkipList(const SkipList&) = delete;
 
         SkipList& operator=(const SkipList&) = delete;
 
         void insert(const Key &key);            // insert key into the list. key mustn't already in the list
+        void insert_with_hint(const Key &key, Splice *hint);    // like insert(), reusing the path cached in *hint
+        template<typename InputIt>
+        void insert_sorted(InputIt first, InputIt last);        // insert pre-sorted keys [first, last)
+        void insert_concurrently(const Key &key);   // like insert(), but safe with other concurrent insert_concurrently()
         bool contains(const Key &key) const;    // return true iff an entry that compares eqaul to key is in the list
+        void prefetch_from(const Splice &finger) const; // prefetch nodes a search from finger goes on to
 
     private:
         const static int MAX_HEIGHT = 12;
@@ -50,22 +78,66 @@ namespace stackdb {
             return max_height.load(std::memory_order_relaxed);
         } 
         int random_height();                        
+        int random_height_concurrently();           // same as random_height(), with a per-thread generator
 
         bool equal(const Key &a, const Key &b) const {
             return compare(a, b) == 0;
         }
+        static bool key_prefix_enabled(const Comparator &cmp) {
+            if constexpr (has_key_prefix<Comparator, Key>::value) {
+                return cmp.key_prefix_enabled();
+            }
+            return false;
+        }
+        // return the inline prefix of key, or 0 if prefixes are not in use
+        uint64_t prefix_of(const Key &key) const {
+            if constexpr (has_key_prefix<Comparator, Key>::value) {
+                if (use_prefix) return compare.key_prefix(key);
+            }
+            return 0;
+        }
+        // key_prefix shall be prefix_of(key). prefixes decide the order unless they are equal
+        bool key_is_after_node(const Key &key, uint64_t key_prefix, Node *n) const {
+            if (n == nullptr) return false;
+            if (use_prefix && n->prefix() != key_prefix) {
+                return n->prefix() < key_prefix;
+            }
+            return compare(n->key, key) < 0;
+        }
         bool key_is_after_node(const Key &key, Node *n) const {
-            return (n != nullptr) && (compare(n->key, key) < 0);
+            return key_is_after_node(key, prefix_of(key), n);
         }
 
-        Node *new_node(const Key &key, int height);                     // return earliest node that comes at or after key, and 
+        Node *new_node(const Key &key, int height, uint64_t prefix, bool concurrent = false);
+                                                                        // return earliest node that comes at or after key, and 
         Node *find_greater_or_equal(const Key &key, Node **prev) const; //  fill prev for every level in [0, max_height - 1]
+        // same as find_greater_or_equal(), but starts from the path of the last search cached
+        // in *finger, so ascending keys close together skip most of the descent
+        Node *find_greater_or_equal_from(const Key &key, Splice *finger) const;
+        // starting at before, walk level to find the nodes that bracket key there,
+        // i.e. *out_prev < key <= *out_next. after bounds the walk if non-null
+        void find_splice_for_level(const Key &key, uint64_t key_prefix, Node *before, Node *after,
+                                   int level, Node **out_prev, Node **out_next) const;
         Node *find_less_than(const Key& key) const;                     // return the latested node with k < key or head
         Node *find_last() const;                                        // return the last (rightest and lowest) node, head if empty
 
+        // backward links. a link is only a hint: it always points to some node before n,
+        // but a racing insert_concurrently() may leave it short of the real predecessor
+        std::atomic<Node *> *back_link(Node *n) const {
+            char *p = reinterpret_cast<char *>(n) - (use_prefix ? sizeof(uint64_t) : 0);
+            return reinterpret_cast<std::atomic<Node *> *>(p) - 1;
+        }
+        Node *find_prev(Node *n) const;                                 // return the node right before n, head if first
+        void set_back_link(Node *node, Node *prev) {                    // before node is published at level 0
+            if (backward_link) back_link(node)->store(prev, std::memory_order_relaxed);
+        }
+        void link_successor_back(Node *node, Node *prev, bool concurrent); // after node is published at level 0
+
         // immuatable after construction
         const Comparator compare;
         Arena *const arena;
+        const bool use_prefix;      // true if nodes carry the comparator's key prefix
+        const bool backward_link;   // true if nodes carry a back link
         Node *const head;
         std::atomic<int> max_height;
         Random rnd;
@@ -87,10 +159,115 @@ namespace stackdb {
             max_height.store(height, std::memory_order_relaxed);
         }
 
-        node = new_node(key, height);
+        node = new_node(key, height, prefix_of(key));
         for (int i = 0; i < height; i ++) {
             node->no_barrier_set_next(i, prev[i]->no_barrier_next(i));
+            if (i == 0) set_back_link(node, prev[0]);
             prev[i]->set_next(i, node);
+            if (i == 0) link_successor_back(node, prev[0], false);
+        }
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::insert_with_hint(const Key& key, Splice *hint) {
+        // random height for the new node, update max_height if needed
+        int height = random_height();
+        int list_height = get_max_height();
+        if (height > list_height) {
+            max_height.store(height, std::memory_order_relaxed);
+            list_height = height;
+        }
+
+        // find the lowest level where the cached splice still brackets key. a splice
+        // is nested, so every level above it brackets key too. if none, start from head
+        uint64_t key_prefix = prefix_of(key);
+        int level = 0;
+        if (hint->height < list_height) {
+            hint->prev[list_height] = head;
+            hint->next[list_height] = nullptr;
+            hint->height = list_height;
+            level = list_height;
+        } else {
+            while (level < list_height) {
+                Node *prev = hint->prev[level], *next = hint->next[level];
+                if (prev->next(level) != next) {                            // stale, node inserted in between
+                    level ++;
+                } else if (prev != head && !key_is_after_node(key, key_prefix, prev)) { // key is before the splice
+                    level ++;
+                } else if (key_is_after_node(key, key_prefix, next)) {                  // key is after the splice
+                    level ++;
+                } else {
+                    break;
+                }
+            }
+        }
+        // descend from there, each level bounded by the splice one level above
+        for (int i = level - 1; i >= 0; i --) {
+            find_splice_for_level(key, key_prefix, hint->prev[i + 1], hint->next[i + 1], i,
+                                  &hint->prev[i], &hint->next[i]);
+        }
+        // check no duplicate before insertion
+        assert(hint->next[0] == nullptr || !equal(hint->next[0]->key, key));
+
+        // the new node becomes prev for all its levels, so an ascending key stream
+        // finds a valid splice at level 0 next time
+        Node *node = new_node(key, height, key_prefix);
+        for (int i = 0; i < height; i ++) {
+            node->no_barrier_set_next(i, hint->next[i]);
+            if (i == 0) set_back_link(node, hint->prev[0]);
+            hint->prev[i]->set_next(i, node);
+            if (i == 0) link_successor_back(node, hint->prev[0], false);
+            hint->prev[i] = node;
+        }
+    }
+
+    template<typename Key, class Comparator>
+    template<typename InputIt>
+    void SkipList<Key, Comparator>::insert_sorted(InputIt first, InputIt last) {
+        Splice hint;
+        for (; first != last; ++first) {
+            insert_with_hint(*first, &hint);
+        }
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::insert_concurrently(const Key& key) {
+        // raise max_height with cas. a reader seeing the new height before the node
+        // is linked just walks down from head through null links, which is fine
+        int height = random_height_concurrently();
+        int list_height = get_max_height();
+        while (height > list_height) {
+            if (max_height.compare_exchange_weak(list_height, height)) {
+                list_height = height;
+                break;
+            }
+        }
+
+        // compute the splice top-down from head, at every level of the list
+        uint64_t key_prefix = prefix_of(key);
+        Node *prev[MAX_HEIGHT + 1];
+        Node *next[MAX_HEIGHT + 1];
+        prev[list_height] = head;
+        next[list_height] = nullptr;
+        for (int i = list_height - 1; i >= 0; i --) {
+            find_splice_for_level(key, key_prefix, prev[i + 1], next[i + 1], i, &prev[i], &next[i]);
+        }
+        // check no duplicate before insertion
+        assert(next[0] == nullptr || !equal(next[0]->key, key));
+
+        // link bottom-up, so the node is reachable at level 0 once reachable at all.
+        // if another writer changed prev[i] in between, recompute the splice at that level
+        Node *node = new_node(key, height, key_prefix, true);
+        for (int i = 0; i < height; i ++) {
+            while (true) {
+                node->no_barrier_set_next(i, next[i]);
+                if (i == 0) set_back_link(node, prev[0]);
+                if (prev[i]->cas_next(i, next[i], node)) {
+                    if (i == 0) link_successor_back(node, prev[0], true);
+                    break;
+                }
+                find_splice_for_level(key, key_prefix, prev[i], nullptr, i, &prev[i], &next[i]);
+            }
         }
     }
 
@@ -101,8 +278,9 @@ namespace stackdb {
     }
 
     template<typename Key, class Comparator>
-    SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena *arena)
-        :compare(cmp), arena(arena), head(new_node(0, MAX_HEIGHT)), max_height(1), rnd(0xdeadbeef) {
+    SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena *arena, bool backward_link)
+        :compare(cmp), arena(arena), use_prefix(key_prefix_enabled(cmp)), backward_link(backward_link),
+         head(new_node(0, MAX_HEIGHT, 0)), max_height(1), rnd(0xdeadbeef) {
         for (int i = 0; i < MAX_HEIGHT; i ++)
             head->set_next(i, nullptr);
     }
@@ -117,22 +295,47 @@ namespace stackdb {
         return height;
     }
 
+    template<typename Key, class Comparator>
+    int SkipList<Key, Comparator>::random_height_concurrently() {
+        static thread_local Random tl_rnd(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        int branching = 4, height = 1;
+        while (height < MAX_HEIGHT && ((tl_rnd.next() % branching) == 0))
+            height++;
+        assert(height > 0);
+        assert(height <= MAX_HEIGHT);
+        return height;
+    }
+
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
-    SkipList<Key, Comparator>::new_node(const Key& key, int height) {
-        char *const node_memory = arena->allocate_aligned(
-            sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1));
-        return new (node_memory) Node(key); // replacement new
+    SkipList<Key, Comparator>::new_node(const Key& key, int height, uint64_t prefix, bool concurrent) {
+        // layout: [back link, if backward_link] | [prefix, if use_prefix] | key | nexts[height]
+        size_t link_size = backward_link ? sizeof(std::atomic<Node *>) : 0;
+        size_t prefix_size = use_prefix ? sizeof(uint64_t) : 0;
+        size_t node_size = link_size + prefix_size + sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1);
+        char *const node_memory = concurrent ? arena->allocate_aligned_concurrently(node_size)
+                                             : arena->allocate_aligned(node_size);
+        if (backward_link) {
+            new (node_memory) std::atomic<Node *>(nullptr);
+        }
+        if (use_prefix) {
+            *reinterpret_cast<uint64_t *>(node_memory + link_size) = prefix;
+        }
+        return new (node_memory + link_size + prefix_size) Node(key); // replacement new
     }
 
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
     SkipList<Key, Comparator>::find_greater_or_equal(const Key& key, Node **prev) const {
+        uint64_t key_prefix = prefix_of(key);
         int level = get_max_height() - 1;
         Node *cur = head, *next;
         while (true) {
             next = cur->next(level);
-            if (key_is_after_node(key, next)) { // keep search at this level
+            if (next != nullptr) {              // warm up the node we will likely visit next
+                __builtin_prefetch(next->no_barrier_next(level));
+            }
+            if (key_is_after_node(key, key_prefix, next)) { // keep search at this level
                 cur = next;
             } else {
                 if (prev != nullptr) prev[level] = cur;
@@ -145,15 +348,73 @@ namespace stackdb {
         }
     }
 
+    template<typename Key, class Comparator>
+    typename SkipList<Key, Comparator>::Node *
+    SkipList<Key, Comparator>::find_greater_or_equal_from(const Key& key, Splice *finger) const {
+        // like insert_with_hint(), climb to the lowest level where the finger brackets key
+        uint64_t key_prefix = prefix_of(key);
+        int list_height = get_max_height();
+        int level = 0;
+        if (finger->height < list_height) {
+            finger->prev[list_height] = head;
+            finger->next[list_height] = nullptr;
+            finger->height = list_height;
+            level = list_height;
+        } else {
+            while (level < list_height) {
+                Node *prev = finger->prev[level], *next = finger->next[level];
+                if (prev->next(level) != next
+                        || (prev != head && !key_is_after_node(key, key_prefix, prev))
+                        || key_is_after_node(key, key_prefix, next)) {
+                    level ++;
+                } else {
+                    break;
+                }
+            }
+        }
+        for (int i = level - 1; i >= 0; i --) {
+            find_splice_for_level(key, key_prefix, finger->prev[i + 1], finger->next[i + 1], i,
+                                  &finger->prev[i], &finger->next[i]);
+        }
+        return finger->next[0];
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::prefetch_from(const Splice &finger) const {
+        // a search for a key just after the finger climbs its levels, then walks on from the
+        // next nodes there, which it has loaded already. fetch the nodes after them
+        for (int i = 0; i < finger.height; i ++) {
+            Node *next = finger.next[i];
+            if (next == nullptr) break;     // so are those of higher levels
+            __builtin_prefetch(next->no_barrier_next(i));
+        }
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::find_splice_for_level(const Key &key, uint64_t key_prefix, Node *before,
+                                                          Node *after, int level, Node **out_prev,
+                                                          Node **out_next) const {
+        while (true) {
+            Node *next = before->next(level);
+            if (next == after || !key_is_after_node(key, key_prefix, next)) {
+                *out_prev = before;
+                *out_next = next;
+                return;
+            }
+            before = next;
+        }
+    }
+
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
     SkipList<Key, Comparator>::find_less_than(const Key& key) const {
+        uint64_t key_prefix = prefix_of(key);
         int level = get_max_height() - 1;
         Node *cur = head, *next;
         while (true) {
             assert(cur == head || compare(cur->key, key) < 0);
             next = cur->next(level);
-            if (next == nullptr || compare(next->key, key) >= 0) {
+            if (!key_is_after_node(key, key_prefix, next)) {
                 if (level == 0) {
                     return cur;
                 } else {        // switch to next level
@@ -184,6 +445,35 @@ namespace stackdb {
         }
     }
 
+    template<typename Key, class Comparator>
+    typename SkipList<Key, Comparator>::Node *
+    SkipList<Key, Comparator>::find_prev(Node *n) const {
+        if (!backward_link) {
+            return find_less_than(n->key);
+        }
+        // the link may lag behind concurrent inserts, catch up along level 0
+        Node *cur = back_link(n)->load(std::memory_order_acquire), *next;
+        while ((next = cur->next(0)) != n) {
+            assert(next != nullptr);
+            cur = next;
+        }
+        return cur;
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::link_successor_back(Node *node, Node *prev, bool concurrent) {
+        if (!backward_link) return;
+        Node *next = node->no_barrier_next(0);
+        if (next == nullptr) return;
+        if (concurrent) {
+            // a racing insert between node and next may have claimed next already
+            Node *expected = prev;
+            back_link(next)->compare_exchange_strong(expected, node, std::memory_order_release);
+        } else {
+            back_link(next)->store(node, std::memory_order_release);
+        }
+    }
+
     // SkipList::Node
     template<typename Key, class Comparator>
     struct SkipList<Key, Comparator>::Node {
@@ -193,11 +483,28 @@ namespace stackdb {
         void set_next(int n, Node *x)            { assert(n >= 0); nexts[n].store(x, std::memory_order_release); }
         Node *no_barrier_next(int n )            { assert(n >= 0); return nexts[n].load(std::memory_order_relaxed); }
         void no_barrier_set_next(int n, Node *x) { assert(n >= 0); nexts[n].store(x, std::memory_order_relaxed); }
+        uint64_t prefix() const { return reinterpret_cast<const uint64_t *>(this)[-1]; } // only if use_prefix
+        bool cas_next(int n, Node *expected, Node *x) {
+            assert(n >= 0);
+            return nexts[n].compare_exchange_strong(expected, x, std::memory_order_acq_rel);
+        }
 
         const Key key;
         std::atomic<Node*> nexts[1];     // array of next nodes with length equal to node height. next[0] is the lowest level link
     };
 
+    // SkipList::Splice
+    // prev[i] < key <= next[i] around the last key inserted with it, for level i < height.
+    // prev[height] is head. a splice shall only be used with the list it was first used on
+    template<typename Key, class Comparator>
+    struct SkipList<Key, Comparator>::Splice {
+        Splice(): height(0) {}
+
+        int height;
+        Node *prev[MAX_HEIGHT + 1];
+        Node *next[MAX_HEIGHT + 1];
+    };
+
     // SkipList::Iterator
     // It doesn't implement stackdb::Iterator so as to avoid virtual function cost
     // and also doesn't provide key() & status() as specified by stackdb::Iterator
@@ -215,7 +522,7 @@ namespace stackdb {
         // advance to the previous position. requires valid()
         void prev() {
             assert(valid());
-            node = list->find_less_than(node->key);
+            node = list->find_prev(node);
             if (node == list->head) {
                 node = nullptr;
             }
@@ -224,6 +531,11 @@ namespace stackdb {
         void seek(const Key &target) { 
             node = list->find_greater_or_equal(target, nullptr);
         }
+        // same as seek(), but searches from *finger and leaves the search path there. for
+        // seeking many targets, fastest in ascending order
+        void seek(const Key &target, Splice *finger) {
+            node = list->find_greater_or_equal_from(target, finger);
+        }
         // position at the first entry. valid iff list is not empty
         void seek_to_first() { node = list->head->next(0); }
         // position at the last entry. valid iff list is not empty
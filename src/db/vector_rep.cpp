@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <mutex>
+#include "db/memtable_rep.h"
+
+namespace stackdb {
+namespace {
+    // entries appended to a vector under a mutex, and sorted on the first read after writes.
+    // iterators share the sorted vector, so writes after that copy it first
+    class VectorRep: public MemTableRep {
+    public:
+        explicit VectorRep(const MemTableKeyComparator &cmp)
+            : cmp(cmp), entries(std::make_shared<std::vector<const char *>>()), sorted_count(0) {}
+
+        void insert(const char *entry) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            unshare();
+            entries->push_back(entry);
+        }
+        void insert_concurrently(const char *entry) override { insert(entry); }
+
+        void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            sort();
+            auto iter = std::lower_bound(entries->begin(), entries->end(), key, less());
+            for (; iter != entries->end() && callback(arg, *iter); ++iter) {}
+        }
+
+        MemTableRep::Iterator *new_iterator() override {
+            std::lock_guard<std::mutex> lock(mutex);
+            sort();
+            return new_snapshot_iterator(cmp, entries);
+        }
+
+        size_t approxi_mem_usage() const override {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries->capacity() * sizeof(const char *);
+        }
+
+    private:
+        struct Less {
+            const MemTableKeyComparator &cmp;
+            bool operator()(const char *a, const char *b) const { return cmp(a, b) < 0; }
+        };
+        Less less() const { return Less{cmp}; }
+        // copy entries if an iterator still holds them. requires mutex held
+        void unshare() {
+            if (entries.use_count() > 1) {
+                entries = std::make_shared<std::vector<const char *>>(*entries);
+            }
+        }
+        // sort entries appended since the last sort, and merge them in. requires mutex held
+        void sort() {
+            if (sorted_count == entries->size()) return;
+            unshare();
+            auto middle = entries->begin() + sorted_count;
+            std::sort(middle, entries->end(), less());
+            std::inplace_merge(entries->begin(), middle, entries->end(), less());
+            sorted_count = entries->size();
+        }
+
+        const MemTableKeyComparator cmp;
+        mutable std::mutex mutex;
+        std::shared_ptr<std::vector<const char *>> entries;
+        size_t sorted_count;    // entries[0, sorted_count - 1] are sorted
+    };
+
+    class VectorRepFactory: public MemTableRepFactory {
+    public:
+        const char *name() const override { return "stackdb.VectorRep"; }
+        MemTableRep *create(const MemTableKeyComparator &cmp, Arena *arena) const override {
+            return new VectorRep(cmp);
+        }
+    };
+} // anonymous namespace
+
+MemTableRepFactory *new_vector_rep_factory() {
+    return new VectorRepFactory();
+}
+
+} // namespace stackdb
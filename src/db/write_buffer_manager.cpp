@@ -0,0 +1,53 @@
+#include <vector>
+#include "db/memtable.h"
+#include "db/write_buffer_manager.h"
+
+namespace stackdb {
+
+void WriteBufferManager::add_flush_candidate(MemTable *mem, FlushFunction flush, void *arg) {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(flushing.count(mem) == 0);
+    candidates[mem] = Candidate{flush, arg};
+}
+
+void WriteBufferManager::remove_memtable(MemTable *mem) {
+    std::lock_guard<std::mutex> lock(mutex);
+    candidates.erase(mem);
+    auto iter = flushing.find(mem);
+    if (iter != flushing.end()) {
+        memory_being_freed.fetch_sub(iter->second, std::memory_order_relaxed);
+        flushing.erase(iter);
+    }
+}
+
+void WriteBufferManager::maybe_flush() {
+    std::vector<std::pair<MemTable *, Candidate>> picked;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // candidates can't be destroyed meanwhile, as ~MemTable() waits for the lock. those
+        // whose last ref is gone are about to, so they are left to remove_memtable()
+        while (should_flush() && !candidates.empty()) {
+            auto largest = candidates.begin();
+            size_t largest_usage = largest->first->approxi_mem_usage();
+            for (auto iter = std::next(largest); iter != candidates.end(); ++iter) {
+                size_t usage = iter->first->approxi_mem_usage();
+                if (usage > largest_usage) {
+                    largest = iter;
+                    largest_usage = usage;
+                }
+            }
+            if (largest->first->try_ref()) {    // keeps it alive for its callback, after the lock
+                picked.push_back(*largest);
+                flushing[largest->first] = largest_usage;
+                memory_being_freed.fetch_add(largest_usage, std::memory_order_relaxed);
+            }
+            candidates.erase(largest);
+        }
+    }
+    for (auto &p : picked) {
+        p.second.flush(p.second.arg, p.first);
+        p.first->unref();
+    }
+}
+
+} // namespace stackdb
@@ -0,0 +1,68 @@
+#ifndef STACKDB_WRITE_BUFFER_MANAGER_H
+#define STACKDB_WRITE_BUFFER_MANAGER_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+namespace stackdb {
+    class MemTable;
+
+    // caps the total memory of memtables across the DBs of a process. arenas of memtables
+    // built with a manager charge their blocks to it. owners register their mutable memtables
+    // as flush candidates, and when usage goes over budget, the largest candidates are handed
+    // back to their owners to flush until the memory not yet being freed fits the budget.
+    //
+    // shared by many memtables, and must outlive them. thread-safe
+    class WriteBufferManager {
+    public:
+        // asks the owner of mem to flush it, e.g. by switching to a new memtable and scheduling
+        // a background flush. called without the manager's lock, from the thread whose write
+        // went over budget, so it should not block on the flush. the manager holds a ref on mem
+        // during the call, and drops it after
+        typedef void (*FlushFunction)(void *arg, MemTable *mem);
+
+        // if buffer_size is 0 there is no budget, and usage is only counted
+        explicit WriteBufferManager(size_t buffer_size): buffer_size(buffer_size), memory_usage(0), memory_being_freed(0) {}
+        WriteBufferManager(const WriteBufferManager &) = delete;
+        WriteBufferManager& operator=(const WriteBufferManager&) = delete;
+
+        size_t get_buffer_size() const { return buffer_size; }
+        // charged by all arenas
+        size_t get_memory_usage() const { return memory_usage.load(std::memory_order_relaxed); }
+        // of memtables handed to their owners to flush, which are not destroyed yet
+        size_t get_memory_being_freed() const { return memory_being_freed.load(std::memory_order_relaxed); }
+
+        // charged by arenas per block, and released when an arena is destroyed
+        void reserve_mem(size_t bytes) { memory_usage.fetch_add(bytes, std::memory_order_relaxed); }
+        void free_mem(size_t bytes) { memory_usage.fetch_sub(bytes, std::memory_order_relaxed); }
+
+        // make mem a flush candidate, until it's picked, removed or destroyed
+        void add_flush_candidate(MemTable *mem, FlushFunction flush, void *arg);
+        // forget mem, e.g. when the owner switches to a new memtable itself. called by ~MemTable()
+        void remove_memtable(MemTable *mem);
+
+        // whether memory not yet being freed is over budget
+        bool should_flush() const {
+            return buffer_size > 0 && get_memory_usage() > get_memory_being_freed() + buffer_size;
+        }
+        // if should_flush(), hand the largest candidates to their owners until it's not.
+        // called by MemTable::add() after a write
+        void maybe_flush();
+
+    private:
+        struct Candidate {
+            FlushFunction flush;
+            void *arg;
+        };
+
+        const size_t buffer_size;
+        std::atomic<size_t> memory_usage;
+        std::atomic<size_t> memory_being_freed;
+        std::mutex mutex;   // guards the maps below
+        std::map<MemTable *, Candidate> candidates;
+        std::map<MemTable *, size_t> flushing;      // picked memtables, to their usage when picked
+    };
+}
+
+#endif
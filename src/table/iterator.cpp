@@ -1,11 +1,18 @@
 #include "stackdb/iterator.h"
 using namespace stackdb;
 
+Iterator::Iterator() {
+    cleanup_head.func = nullptr;
+    cleanup_head.next = nullptr;
+}
+
 Iterator::~Iterator() {
     if (cleanup_head.is_empty()) return;
 
-    // traverse and run each clenaup function from head in the list
-    cleanup_node *node = &cleanup_head, *next;
+    // traverse and run each clenaup function from head in the list.
+    // head node is a member, only the ones after it are allocated
+    cleanup_head.run();
+    cleanup_node *node = cleanup_head.next, *next;
     while (node != nullptr) {
         node->run();
         next = node->next;
@@ -25,6 +32,7 @@ void Iterator::register_cleanup(cleanup_func func, void *arg1, void *arg2) {
         node->next = cleanup_head.next;
         cleanup_head.next = node;
     }
+    node->func = func;
+    node->arg1 = arg1;
+    node->arg2 = arg2;
 }
-
-
@@ -2,10 +2,183 @@
 using std::cout;
 using std::endl;
 
+#include <algorithm>
+#include <sstream>
+#include <sys/mman.h>       // mmap(), madvise(), munmap()
 #include "arena.h"
+#include "db/write_buffer_manager.h"
 using namespace stackdb;
 
+void ArenaBlock::free() const {
+    if (mapped) {
+        ::munmap(data, size);
+    } else {
+        delete[] data;
+    }
+}
+
+ArenaBlockPool::~ArenaBlockPool() {
+    for (auto &block : blocks)
+        block.free();
+}
+
+bool ArenaBlockPool::take(size_t size, ArenaBlock *block) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = blocks.size(); i > 0; i --) {
+        if (blocks[i - 1].size == size) {
+            *block = blocks[i - 1];
+            blocks.erase(blocks.begin() + (i - 1));
+            retained_bytes -= size;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ArenaBlockPool::give_back(const ArenaBlock &block) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (retained_bytes + block.size <= retention_bytes) {
+            blocks.push_back(block);
+            retained_bytes += block.size;
+            return;
+        }
+    }
+    block.free();
+}
+
+size_t ArenaBlockPool::get_retained_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return retained_bytes;
+}
+
+std::string ArenaStats::to_string() const {
+    std::ostringstream ss;
+    ss << "allocated: " << allocated_bytes << ", used: " << used_bytes
+       << ", wasted tail: " << wasted_tail_bytes << ", alignment padding: " << alignment_padding_bytes
+       << ", unused: " << unused_bytes() << "\n";
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i ++) {
+        if (size_histogram[i] == 0) continue;
+        ss << "  [" << (i == 0 ? 0 : 1ull << i) << ", ";
+        if (i == HISTOGRAM_BUCKETS - 1) {
+            ss << "inf";
+        } else {
+            ss << (1ull << (i + 1));
+        }
+        ss << "): " << size_histogram[i] << "\n";
+    }
+    return ss.str();
+}
+
+namespace {
+    // add to a stat. a plain read-modify-write is enough without concurrent writers
+    template <typename T>
+    inline void add_to(std::atomic<T> &stat, T n, bool concurrent) {
+        if (concurrent) {
+            stat.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            stat.store(stat.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    }
+}
+
+Arena::Arena(size_t block_size, size_t max_block_size, size_t huge_page_size, ArenaBlockPool *pool,
+             WriteBufferManager *write_buffer_manager)
+    : alloc_ptr(nullptr), alloc_remaining(0), block_size(block_size),
+      max_block_size(std::max(block_size, max_block_size)), huge_page_size(huge_page_size), pool(pool),
+      write_buffer_manager(write_buffer_manager), mem_usage(0), allocated_bytes(0), used_bytes(0), wasted_tail_bytes(0), alignment_padding_bytes(0) {
+    assert(block_size > 0);
+    for (auto &count : size_histogram) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+Arena::~Arena() {
+    if (write_buffer_manager != nullptr) {
+        write_buffer_manager->free_mem(get_mem_usage());
+    }
+    for (size_t i = 0, n_blocks = blocks.size(); i < n_blocks; i ++)
+        delete[] blocks[i];
+    for (auto &block : regular_blocks) {
+        if (pool != nullptr) {
+            pool->give_back(block);
+        } else {
+            block.free();
+        }
+    }
+}
+
 char *Arena::allocate(size_t bytes) {
+    record_allocation(bytes, 0, false);
+    return allocate_unrecorded(bytes);
+}
+
+char *Arena::allocate_aligned(size_t bytes) {
+    size_t slop;
+    char *result = allocate_aligned_unrecorded(bytes, &slop);
+    record_allocation(bytes, slop, false);
+    return result;
+}
+
+char *Arena::allocate_concurrently(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    char *result = allocate_unrecorded(bytes);
+    record_allocation(bytes, 0, true);
+    return result;
+}
+
+char *Arena::allocate_aligned_concurrently(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slop;
+    char *result = allocate_aligned_unrecorded(bytes, &slop);
+    record_allocation(bytes, slop, true);
+    return result;
+}
+
+char *Arena::allocate_chunk_concurrently(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    constexpr int align = sizeof(void *);
+    size_t current_mod = (size_t)alloc_ptr & (align - 1);
+    size_t slop = current_mod == 0 ? 0 : align - current_mod;
+    if (bytes + slop <= alloc_remaining) {
+        char *result = alloc_ptr + slop;
+        alloc_ptr += bytes + slop;
+        alloc_remaining -= bytes + slop;
+        add_to(alignment_padding_bytes, slop, true);
+        return result;
+    }
+    // unlike allocate_fallback(), chunks always come from regular blocks whatever their size
+    // next to block_size, so they are pooled, huge page backed and grow like other blocks
+    return allocate_from_new_regular_block(bytes);
+}
+
+void Arena::record_allocation(size_t bytes, size_t slop, bool concurrent) {
+    int bucket = (bytes == 0) ? 0 : 63 - __builtin_clzll(bytes);
+    if (bucket >= ArenaStats::HISTOGRAM_BUCKETS) bucket = ArenaStats::HISTOGRAM_BUCKETS - 1;
+    add_to(size_histogram[bucket], uint64_t(1), concurrent);
+    add_to(used_bytes, bytes, concurrent);
+    if (slop > 0) {
+        add_to(alignment_padding_bytes, slop, concurrent);
+    }
+}
+
+void Arena::record_wasted_tail(size_t bytes, bool concurrent) {
+    add_to(wasted_tail_bytes, bytes, concurrent);
+}
+
+ArenaStats Arena::get_stats() const {
+    ArenaStats stats;
+    stats.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+    stats.used_bytes = used_bytes.load(std::memory_order_relaxed);
+    stats.wasted_tail_bytes = wasted_tail_bytes.load(std::memory_order_relaxed);
+    stats.alignment_padding_bytes = alignment_padding_bytes.load(std::memory_order_relaxed);
+    for (int i = 0; i < ArenaStats::HISTOGRAM_BUCKETS; i ++) {
+        stats.size_histogram[i] = size_histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+char *Arena::allocate_unrecorded(size_t bytes) {
     assert(bytes < MAX_ALLOC_SIZE);
     if (bytes < alloc_remaining) {
         char *result = alloc_ptr;
@@ -16,21 +189,22 @@ char *Arena::allocate(size_t bytes) {
     return allocate_fallback(bytes);
 }
 
-char *Arena::allocate_aligned(size_t bytes) {
+char *Arena::allocate_aligned_unrecorded(size_t bytes, size_t *slop) {
     constexpr int align = sizeof(void *);
     static_assert((align == 4) | (align == 8), "align must be 4 or 8");
 
     size_t current_mod = (size_t)alloc_ptr & (align - 1);
-    size_t slop = current_mod == 0 ? 0 : align - current_mod;
-    size_t needed = bytes + slop;
+    *slop = current_mod == 0 ? 0 : align - current_mod;
+    size_t needed = bytes + *slop;
 
     char *result;
     if (needed <= alloc_remaining) {
-        result = alloc_ptr + slop;
+        result = alloc_ptr + *slop;
         alloc_ptr += needed;
         alloc_remaining -= needed;
     } else {
-        result = allocate_new_block(bytes); // malloc/new guarantees alignment. anyway we do a last check
+        *slop = 0;
+        result = allocate_fallback(bytes);  // new blocks are aligned. anyway we do a last check
     }
 
     assert(((size_t)result & (align - 1)) == 0);
@@ -40,12 +214,20 @@ char *Arena::allocate_aligned(size_t bytes) {
 char* Arena::allocate_fallback(size_t bytes) {
     // avoid wasting too much space in leftover bytes. if alloc 1025 bytes in this 4096,
     // then if next alloc > 3072, then the leftover 3072 bytes in this block are wasted!
-    if (bytes > BLOCK_SIZE / 4) {
+    if (bytes > block_size / 4) {
         return allocate_new_block(bytes);
     }
 
-    alloc_ptr = allocate_new_block(BLOCK_SIZE);
-    alloc_remaining = BLOCK_SIZE;
+    return allocate_from_new_regular_block(bytes);
+}
+
+char *Arena::allocate_from_new_regular_block(size_t bytes) {
+    // rare, so always atomic in case ConcurrentArena shards are recording too
+    record_wasted_tail(alloc_remaining, true);
+    size_t size = std::max(block_size, bytes);
+    alloc_ptr = allocate_regular_block(&size);
+    alloc_remaining = size;
+    block_size = std::min(block_size * 2, max_block_size);
     // alloc on the site now
     char *result = alloc_ptr;
     alloc_ptr += bytes;
@@ -57,6 +239,59 @@ char *Arena::allocate_new_block(size_t block_bytes) {
     char *result = new char[block_bytes];
     blocks.push_back(result);
     // update total memory usage, counting the memory taken by the char* pointer in block vector
-    mem_usage.fetch_add(block_bytes + sizeof(char *), std::memory_order_relaxed);
+    add_mem_usage(block_bytes + sizeof(char *));
+    add_to(allocated_bytes, block_bytes, false);
     return result;
 }
+
+void Arena::add_mem_usage(size_t bytes) {
+    mem_usage.fetch_add(bytes, std::memory_order_relaxed);
+    if (write_buffer_manager != nullptr) {
+        write_buffer_manager->reserve_mem(bytes);
+    }
+}
+
+char *Arena::allocate_regular_block(size_t *bytes) {
+    ArenaBlock block = {nullptr, *bytes, false};
+    if (huge_page_size > 0) {
+        block.size = (block.size + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+    if (pool == nullptr || !pool->take(block.size, &block)) {
+        if (huge_page_size > 0) {
+            block.data = map_huge_block(block.size);
+            block.mapped = (block.data != nullptr);
+        }
+        if (block.data == nullptr) {
+            block.size = *bytes;
+            block.data = new char[block.size];
+        }
+    }
+    regular_blocks.push_back(block);
+    add_mem_usage(block.size + sizeof(ArenaBlock));
+    add_to(allocated_bytes, block.size, false);
+    *bytes = block.size;
+    return block.data;
+}
+
+char *Arena::map_huge_block(size_t size) {
+    void *addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // explicit huge pages, only if some are reserved by the system
+    addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (addr == MAP_FAILED) {
+        // transparent huge pages need huge page aligned memory, so map one page more and trim
+        char *raw = static_cast<char *>(::mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED) return nullptr;
+        char *aligned = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(raw) + huge_page_size - 1)
+                                                 / huge_page_size * huge_page_size);
+        if (aligned > raw) ::munmap(raw, aligned - raw);
+        ::munmap(aligned + size, raw + huge_page_size - aligned);
+#ifdef MADV_HUGEPAGE
+        ::madvise(aligned, size, MADV_HUGEPAGE);   // a hint. failure still leaves a usable block
+#endif
+        addr = aligned;
+    }
+    return static_cast<char *>(addr);
+}
@@ -3,37 +3,138 @@
 
 #include <vector>
 #include <atomic>
+#include <mutex>
+#include <string>
 #include <cassert>
 
 namespace stackdb {
+    class WriteBufferManager;
+
+    // where the memory of an arena goes. allocated_bytes = used_bytes + wasted_tail_bytes +
+    // alignment_padding_bytes + unused_bytes()
+    struct ArenaStats {
+        const static int HISTOGRAM_BUCKETS = 25;
+
+        size_t allocated_bytes = 0;         // in blocks
+        size_t used_bytes = 0;              // handed out by allocations
+        size_t wasted_tail_bytes = 0;       // left at the end of blocks that were given up for new ones
+        size_t alignment_padding_bytes = 0; // skipped to align allocate_aligned() results
+        // num of allocations by size. bucket i counts sizes in [2^i, 2^(i+1)), and bucket 0 also
+        // counts empty ones
+        uint64_t size_histogram[HISTOGRAM_BUCKETS] = {};
+
+        // free bytes at the end of the current blocks, still to be used
+        size_t unused_bytes() const {
+            return allocated_bytes - used_bytes - wasted_tail_bytes - alignment_padding_bytes;
+        }
+        std::string to_string() const;
+    };
+
+    // a regular arena block, from new[] or mmap()
+    struct ArenaBlock {
+        char *data;
+        size_t size;
+        bool mapped;
+
+        void free() const;
+    };
+
+    // keeps blocks of destroyed arenas for later arenas, so a new memtable reuses memory that
+    // is already faulted in rather than allocating it again. blocks are kept per size, up to
+    // retention_bytes in total. thread-safe, and must outlive the arenas using it
+    class ArenaBlockPool {
+    public:
+        explicit ArenaBlockPool(size_t retention_bytes): retention_bytes(retention_bytes), retained_bytes(0) {}
+        ArenaBlockPool(const ArenaBlockPool&) = delete;
+        ArenaBlockPool& operator=(const ArenaBlockPool&) = delete;
+        ~ArenaBlockPool();
+
+        // take a kept block of exactly size bytes into *block. false if there is none
+        bool take(size_t size, ArenaBlock *block);
+        // keep block for reuse, or free it if the pool is full
+        void give_back(const ArenaBlock &block);
+        size_t get_retained_bytes() const;
+
+    private:
+        const size_t retention_bytes;
+        size_t retained_bytes;
+        std::vector<ArenaBlock> blocks;     // most recently given back last
+        mutable std::mutex mutex;
+    };
+
     class Arena {
         const static size_t MAX_ALLOC_SIZE = 1024 * 1024 * 16;
-        const static size_t BLOCK_SIZE = 4096;
 
         public:
-            Arena(): alloc_ptr(nullptr), alloc_remaining(0) {}
+            const static size_t BLOCK_SIZE = 4096;
+
+            // blocks start at block_size and double up to max_block_size, so a big arena needs
+            // fewer allocations. no growth if max_block_size <= block_size.
+            // if huge_page_size is nonzero, blocks are rounded up to it and mmap'ed on huge pages,
+            // falling back to transparent huge pages and then to plain new[] if unavailable.
+            // if pool is not null, regular blocks are taken from it first and given back to it
+            // when the arena is destroyed.
+            // if write_buffer_manager is not null, blocks are charged to it until the arena is destroyed
+            explicit Arena(size_t block_size = BLOCK_SIZE, size_t max_block_size = 0, size_t huge_page_size = 0,
+                           ArenaBlockPool *pool = nullptr, WriteBufferManager *write_buffer_manager = nullptr);
             Arena(const Arena&) = delete;
             Arena& operator=(const Arena&) = delete;
-            ~Arena() {
-                for (size_t i = 0, n_blocks = blocks.size(); i < n_blocks; i ++)
-                    delete[] blocks[i];
-            }
+            virtual ~Arena();
 
             char *allocate(size_t bytes);
             char *allocate_aligned(size_t bytes);
+            // thread-safe variants serialized by an internal mutex, for concurrent memtable inserts.
+            // don't mix them with the plain variants while other threads are allocating.
+            // ConcurrentArena overrides them to avoid the mutex
+            virtual char *allocate_concurrently(size_t bytes);
+            virtual char *allocate_aligned_concurrently(size_t bytes);
             // return an estimate of used memory in the arena
             size_t get_mem_usage() const { return mem_usage.load(std::memory_order_relaxed); }
+            // snapshot of the arena's accounting. may be a little stale during concurrent allocations
+            ArenaStats get_stats() const;
+
+        protected:
+            // for ConcurrentArena, which hands out chunks of the arena itself.
+            // allocate_aligned_concurrently() without counting the chunk as used
+            char *allocate_chunk_concurrently(size_t bytes);
+            void record_allocation(size_t bytes, size_t slop, bool concurrent);
+            void record_wasted_tail(size_t bytes, bool concurrent);
 
         private:
+            // allocate() and allocate_aligned() without updating the stats
+            char *allocate_unrecorded(size_t bytes);
+            char *allocate_aligned_unrecorded(size_t bytes, size_t *slop);
             char *allocate_fallback(size_t bytes);
+            // start a new regular block of at least block_size bytes, and take bytes from it
+            char *allocate_from_new_regular_block(size_t bytes);
             char *allocate_new_block(size_t bytes);
+            // a block for allocate_fallback(), from the pool, huge pages or new[]
+            char *allocate_regular_block(size_t *bytes);
+            // map a block of bytes on huge pages. null if mmap fails
+            char *map_huge_block(size_t bytes);
+            // count bytes taken for a block in get_mem_usage(), and charge the write buffer manager
+            void add_mem_usage(size_t bytes);
 
         private:
             char *alloc_ptr;
             size_t alloc_remaining;
-            std::vector<char*> blocks;
+            size_t block_size;          // size of the next regular block
+            const size_t max_block_size;
+            const size_t huge_page_size;
+            ArenaBlockPool *const pool;
+            WriteBufferManager *const write_buffer_manager;
+            std::vector<char*> blocks;              // blocks for a single large allocation
+            std::vector<ArenaBlock> regular_blocks; // blocks shared by small allocations
             std::atomic<size_t> mem_usage;
+            std::mutex mutex;   // guards allocations from concurrent writers
+
+            // stats. only block allocations, which are serialized, update allocated_bytes
+            std::atomic<size_t> allocated_bytes;
+            std::atomic<size_t> used_bytes;
+            std::atomic<size_t> wasted_tail_bytes;
+            std::atomic<size_t> alignment_padding_bytes;
+            std::atomic<uint64_t> size_histogram[ArenaStats::HISTOGRAM_BUCKETS];
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,9 +1,10 @@
 #include "stackdb/filter_policy.h"
 #include "stackdb/slice.h"
+#include "util/dynamic_bloom.h"
 #include "util/hash.h"
 
 namespace stackdb {
-    static uint32_t bloom_hash(const Slice& key) {
+    uint32_t bloom_hash(const Slice& key) {
         return hash(key.data(), key.size(), 0xbc9f1d34);
     }
 
@@ -0,0 +1,81 @@
+#include <mutex>
+#include <unordered_map>
+
+#include "util/concurrent_arena.h"
+
+namespace stackdb {
+
+namespace {
+    // a thread's chunk in one arena. a thread keeps a few, so writers switching between
+    // memtables don't throw their chunks away each time
+    struct Shard {
+        uint64_t owner;     // id of the arena, 0 if unused
+        char *ptr;
+        size_t remaining;
+    };
+    const int THREAD_SHARDS = 4;
+    thread_local Shard shards[THREAD_SHARDS];
+
+    std::atomic<uint64_t> next_arena_id(1);
+
+    // live arenas by id, so a thread taking a shard slot from another arena can count the
+    // chunk it gives up. slots collide rarely, so a mutex is fine
+    std::mutex live_arenas_mutex;
+    std::unordered_map<uint64_t, ConcurrentArena *> live_arenas;
+}
+
+ConcurrentArena::ConcurrentArena(size_t block_size, size_t max_block_size, size_t huge_page_size,
+                                 ArenaBlockPool *pool, WriteBufferManager *write_buffer_manager,
+                                 size_t shard_block_size)
+    : Arena(block_size, max_block_size, huge_page_size, pool, write_buffer_manager),
+      id(next_arena_id.fetch_add(1, std::memory_order_relaxed)), shard_block_size(shard_block_size) {
+    std::lock_guard<std::mutex> lock(live_arenas_mutex);
+    live_arenas[id] = this;
+}
+
+ConcurrentArena::~ConcurrentArena() {
+    std::lock_guard<std::mutex> lock(live_arenas_mutex);
+    live_arenas.erase(id);
+}
+
+void ConcurrentArena::release_shard_chunk(uint64_t owner, size_t remaining) {
+    std::lock_guard<std::mutex> lock(live_arenas_mutex);
+    auto it = live_arenas.find(owner);
+    if (it != live_arenas.end()) {
+        it->second->record_wasted_tail(remaining, true);
+    }
+}
+
+char *ConcurrentArena::allocate_from_shard(size_t bytes, bool aligned) {
+    constexpr size_t align = sizeof(void *);
+    // large allocations would waste too much of a chunk
+    if (bytes > shard_block_size / 4) {
+        return aligned ? Arena::allocate_aligned_concurrently(bytes) : Arena::allocate_concurrently(bytes);
+    }
+
+    Shard &shard = shards[id % THREAD_SHARDS];
+    if (shard.owner != id) {
+        // another arena's chunk in this slot is left unused
+        if (shard.owner != 0 && shard.remaining > 0) {
+            release_shard_chunk(shard.owner, shard.remaining);
+        }
+        shard = Shard{id, nullptr, 0};
+    }
+    size_t current_mod = reinterpret_cast<size_t>(shard.ptr) & (align - 1);
+    size_t slop = (!aligned || current_mod == 0) ? 0 : align - current_mod;
+    if (bytes + slop > shard.remaining) {
+        // the rest of the old chunk is left unused
+        record_wasted_tail(shard.remaining, true);
+        shard.ptr = allocate_chunk_concurrently(shard_block_size);
+        shard.remaining = shard_block_size;
+        slop = 0;
+    }
+    record_allocation(bytes, slop, true);
+    char *result = shard.ptr + slop;
+    shard.ptr += bytes + slop;
+    shard.remaining -= bytes + slop;
+    assert(!aligned || (reinterpret_cast<size_t>(result) & (align - 1)) == 0);
+    return result;
+}
+
+} // namespace stackdb
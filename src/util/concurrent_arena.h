@@ -0,0 +1,36 @@
+#ifndef STACKDB_CONCURRENT_ARENA_H
+#define STACKDB_CONCURRENT_ARENA_H
+
+#include "util/arena.h"
+
+namespace stackdb {
+    // Arena whose concurrent allocations come from per-thread shards rather than a mutex.
+    // each thread bump-allocates from a small chunk it owns, and only takes the arena mutex
+    // to refill it. plain allocate() calls go straight to the arena as before.
+    //
+    // chunks are counted in get_mem_usage() once handed to a shard, so it overstates usage by
+    // at most a chunk per writer thread
+    class ConcurrentArena: public Arena {
+        const static size_t DEFAULT_SHARD_BLOCK_SIZE = 8 * 1024;
+
+    public:
+        // block_size, max_block_size, huge_page_size, pool and write_buffer_manager are as in Arena
+        explicit ConcurrentArena(size_t block_size = BLOCK_SIZE, size_t max_block_size = 0, size_t huge_page_size = 0,
+                                 ArenaBlockPool *pool = nullptr, WriteBufferManager *write_buffer_manager = nullptr,
+                                 size_t shard_block_size = DEFAULT_SHARD_BLOCK_SIZE);
+        ~ConcurrentArena() override;
+
+        char *allocate_concurrently(size_t bytes) override { return allocate_from_shard(bytes, false); }
+        char *allocate_aligned_concurrently(size_t bytes) override { return allocate_from_shard(bytes, true); }
+
+    private:
+        char *allocate_from_shard(size_t bytes, bool aligned);
+        // count the rest of a shard's chunk as wasted in the arena owning it, if still alive
+        static void release_shard_chunk(uint64_t owner, size_t remaining);
+
+        const uint64_t id;                  // never reused, so shards of dead arenas are never matched
+        const size_t shard_block_size;
+    };
+}
+
+#endif
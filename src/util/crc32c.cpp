@@ -1,6 +1,11 @@
 #include "util/crc32c.h"
 #include "util/coding.h"
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>      // _mm_crc32_u8(), _mm_crc32_u64()
+#include <wmmintrin.h>      // _mm_clmulepi64_si128()
+#endif
+
 // I don't really understand crc32c and it takes time to comprehend it .so I did a exact copy here
 namespace stackdb {
 namespace crc32c {
@@ -233,6 +238,42 @@ const uint32_t STRIDE_EXT_TBL_3[256] = {
 // CRCs are pre- and post- conditioned by xoring with all ones.
 static constexpr const uint32_t CRC32_XOR = 0xffffffffU;
 
+// crc32c polynomial in reflected bit order, i.e. bit 31 is x^0
+static constexpr const uint32_t CRC32_POLY = 0x82f63b78U;
+
+// return a * b modulo CRC32_POLY. both in reflected bit order.
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31, p = 0;
+  while (true) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+  }
+  return p;
+}
+
+// return x^n modulo CRC32_POLY, by squaring x^(2^k) for each set bit of n
+static uint32_t xnmodp(uint64_t n) {
+  static const struct PowerTable {   // x2k[k] = x^(2^k) mod CRC32_POLY
+    PowerTable() {
+      x2k[0] = 1u << 30;              // x^1
+      for (int k = 1; k < 64; k++) {
+        x2k[k] = multmodp(x2k[k - 1], x2k[k - 1]);
+      }
+    }
+    uint32_t x2k[64];
+  } table;
+
+  uint32_t p = 1u << 31;                  // x^0
+  for (int k = 0; n != 0; n >>= 1, k++) {
+    if (n & 1) p = multmodp(table.x2k[k], p);
+  }
+  return p;
+}
+
 // reads a little-endian 32-bit integer from a 32-bit-aligned buffer.
 inline uint32_t read_uint32_le(const uint8_t* buffer) {
     return decode_fixed_32(reinterpret_cast<const char*>(buffer));
@@ -248,9 +289,7 @@ constexpr inline const uint8_t* round_up(const uint8_t* pointer) {
 }
 }  // namespace
 
-// NEED: check cpu support for accelerating CRC32C calculation
-
-uint32_t extend(uint32_t crc, const char* data, size_t n) {
+uint32_t extend_portable(uint32_t crc, const char* data, size_t n) {
   const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
   const uint8_t* e = p + n;
   uint32_t l = crc ^ CRC32_XOR;
@@ -339,5 +378,107 @@ uint32_t extend(uint32_t crc, const char* data, size_t n) {
   return l ^ CRC32_XOR;
 }
 
+#if defined(__x86_64__)
+namespace {
+// each stream of the 3-way kernel covers this many bytes per round
+const size_t FOLD_STREAM_SIZE = 4096;
+
+// fold constants. shifting a raw crc over n zero bytes is crc32(0, clmul(crc, x^(8n-33))),
+// since clmul of two reflected values gains a factor x and crc32() a factor x^32
+struct FoldConstants {
+    FoldConstants()
+        : k1(xnmodp(8 * FOLD_STREAM_SIZE - 33)), k2(xnmodp(16 * FOLD_STREAM_SIZE - 33)) {}
+    uint64_t k1;    // shift over one stream
+    uint64_t k2;    // shift over two streams
+};
+
+bool is_pclmul_supported() {
+  static const bool supported = __builtin_cpu_supports("pclmul");
+  return supported;
+}
+
+// run three independent crc32 dependency chains over adjacent streams so the
+// instruction latency is hidden, then fold the partial crcs with carry-less multiply.
+// consume as many rounds of 3 * FOLD_STREAM_SIZE bytes as fit in [*pp, e)
+__attribute__((target("sse4.2,pclmul")))
+uint64_t extend_3way(uint64_t l, const uint8_t** pp, const uint8_t* e) {
+  static const FoldConstants fold;
+  const __m128i k = _mm_set_epi64x(fold.k1, fold.k2);
+  const uint8_t* p = *pp;
+
+  while (static_cast<size_t>(e - p) >= 3 * FOLD_STREAM_SIZE) {
+    uint64_t crc0 = l, crc1 = 0, crc2 = 0;
+    const uint8_t* p1 = p + FOLD_STREAM_SIZE;
+    const uint8_t* p2 = p + 2 * FOLD_STREAM_SIZE;
+    for (size_t i = 0; i < FOLD_STREAM_SIZE; i += 8) {
+      crc0 = _mm_crc32_u64(crc0, *reinterpret_cast<const uint64_t*>(p + i));
+      crc1 = _mm_crc32_u64(crc1, *reinterpret_cast<const uint64_t*>(p1 + i));
+      crc2 = _mm_crc32_u64(crc2, *reinterpret_cast<const uint64_t*>(p2 + i));
+    }
+    // crc0 is shifted over two streams, crc1 over one. crc32() is linear so fold once
+    __m128i a = _mm_clmulepi64_si128(_mm_cvtsi64_si128(crc0), k, 0x00);
+    __m128i b = _mm_clmulepi64_si128(_mm_cvtsi64_si128(crc1), k, 0x10);
+    l = _mm_crc32_u64(0, _mm_cvtsi128_si64(_mm_xor_si128(a, b))) ^ crc2;
+    p += 3 * FOLD_STREAM_SIZE;
+  }
+  *pp = p;
+  return l;
+}
+}  // namespace
+
+// sse4.2 crc32 instruction computes exactly crc32c, without the pre- and post- conditioning
+__attribute__((target("sse4.2")))
+uint32_t extend_accelerated(uint32_t crc, const char* data, size_t n) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* e = p + n;
+  uint64_t l = crc ^ CRC32_XOR;
+
+  // process bytes until p is 8-byte aligned.
+  const uint8_t* x = round_up<8>(p);
+  while (p != e && p != x) {
+    l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+  }
+  // large buffers go through the 3-way kernel first
+  if (static_cast<size_t>(e - p) >= 3 * FOLD_STREAM_SIZE && is_pclmul_supported()) {
+    l = extend_3way(l, &p, e);
+  }
+  // process 8 bytes at a time. x86 is little-endian so a plain load keeps byte order
+  while ((e - p) >= 8) {
+    l = _mm_crc32_u64(l, *reinterpret_cast<const uint64_t*>(p));
+    p += 8;
+  }
+  // process the last few bytes.
+  while (p != e) {
+    l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+  }
+  return static_cast<uint32_t>(l) ^ CRC32_XOR;
+}
+
+bool is_accelerated() {
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+  return supported;
+}
+#else
+uint32_t extend_accelerated(uint32_t crc, const char* data, size_t n) {
+  return extend_portable(crc, data, n);   // no hardware support on this arch
+}
+
+bool is_accelerated() {
+  return false;
+}
+#endif
+
+uint32_t extend(uint32_t crc, const char* data, size_t n) {
+  // pick an implementation once, on the first call
+  static uint32_t (*const impl)(uint32_t, const char*, size_t) =
+      is_accelerated() ? extend_accelerated : extend_portable;
+  return impl(crc, data, n);
+}
+
+uint32_t combine(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+  // the pre- and post- conditioning cancel out, leaving crc_a shifted over len_b zero bytes
+  return multmodp(xnmodp(8 * static_cast<uint64_t>(len_b)), crc_a) ^ crc_b;
+}
+
 }
 }
@@ -7,7 +7,18 @@
 namespace stackdb {
 namespace crc32c {
     // return crc32 of concat A | data[0, n - 1] where A's crc is represented as cur_crc
+    // dispatches at runtime to the sse4.2 implementation if the cpu supports it
     uint32_t extend(uint32_t cur_crc, const char *data, size_t n);
+    // table-driven implementation of extend(). works on any cpu
+    uint32_t extend_portable(uint32_t cur_crc, const char *data, size_t n);
+    // sse4.2 crc32 instruction implementation of extend(). requires is_accelerated().
+    // buffers of several KB and up are folded with pclmulqdq if available
+    uint32_t extend_accelerated(uint32_t cur_crc, const char *data, size_t n);
+    // return true if the cpu supports the sse4.2 crc32 instruction
+    bool is_accelerated();
+    // return crc32 of concat A | B, given crc_a of A and crc_b of B which is len_b bytes long.
+    // lets large buffers be checksummed in independent chunks and merged afterwards
+    uint32_t combine(uint32_t crc_a, uint32_t crc_b, size_t len_b);
     // return the crc32 of data[0, n - 1]
     inline uint32_t value(const char *data, size_t n) {
         return extend(0, data, n);
@@ -0,0 +1,51 @@
+#include "util/dynamic_bloom.h"
+
+namespace stackdb {
+
+DynamicBloom::DynamicBloom(Arena *arena, uint32_t total_bits, int num_probes)
+    : num_lines((total_bits + LINE_BITS - 1) / LINE_BITS), num_probes(num_probes) {
+    assert(num_probes > 0);
+    if (num_lines == 0) num_lines = 1;
+    // over-allocate so the bits can start on a cache line boundary
+    const size_t line_bytes = LINE_BITS / 8;
+    char *raw = arena->allocate(num_lines * line_bytes + line_bytes - 1);
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + line_bytes - 1) & ~(line_bytes - 1);
+    data = reinterpret_cast<std::atomic<uint64_t> *>(aligned);
+    for (uint32_t i = 0; i < num_lines * (LINE_BITS / WORD_BITS); i ++) {
+        new (&data[i]) std::atomic<uint64_t>(0);
+    }
+}
+
+// probes are generated with the same double hashing as BloomFilterPolicy
+void DynamicBloom::add_hash(uint32_t h, bool concurrent) {
+    std::atomic<uint64_t> *line = data + line_of(h) * (LINE_BITS / WORD_BITS);
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < num_probes; i ++) {
+        uint32_t bitpos = h % LINE_BITS;
+        uint64_t mask = uint64_t(1) << (bitpos % WORD_BITS);
+        std::atomic<uint64_t> &word = line[bitpos / WORD_BITS];
+        if (concurrent) {
+            word.fetch_or(mask, std::memory_order_relaxed);
+        } else {    // a plain read-modify-write is enough for a single writer
+            word.store(word.load(std::memory_order_relaxed) | mask, std::memory_order_relaxed);
+        }
+        h += delta;
+    }
+}
+
+bool DynamicBloom::may_contain(const Slice &key) const {
+    uint32_t h = bloom_hash(key);
+    const std::atomic<uint64_t> *line = data + line_of(h) * (LINE_BITS / WORD_BITS);
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < num_probes; i ++) {
+        uint32_t bitpos = h % LINE_BITS;
+        uint64_t mask = uint64_t(1) << (bitpos % WORD_BITS);
+        if ((line[bitpos / WORD_BITS].load(std::memory_order_relaxed) & mask) == 0) {
+            return false;
+        }
+        h += delta;
+    }
+    return true;
+}
+
+} // namespace stackdb
@@ -0,0 +1,44 @@
+#ifndef STACKDB_DYNAMIC_BLOOM_H
+#define STACKDB_DYNAMIC_BLOOM_H
+
+#include <atomic>
+#include <cstdint>
+#include "stackdb/slice.h"
+#include "util/arena.h"
+
+namespace stackdb {
+    // hash shared with the built-in BloomFilterPolicy. defined in bloom.cpp
+    uint32_t bloom_hash(const Slice &key);
+
+    // a bloom filter filled one key at a time, like a memtable. bits are allocated from an
+    // arena, and all probes of a key fall in one cache line so a lookup costs one miss.
+    // add() requires external synchronization, add_concurrently() doesn't, and may_contain()
+    // can run alongside both
+    class DynamicBloom {
+    public:
+        // total_bits is rounded up to whole cache lines
+        DynamicBloom(Arena *arena, uint32_t total_bits, int num_probes = 6);
+        DynamicBloom(const DynamicBloom &) = delete;
+        DynamicBloom& operator=(const DynamicBloom&) = delete;
+
+        void add(const Slice &key) { add_hash(bloom_hash(key), false); }
+        void add_concurrently(const Slice &key) { add_hash(bloom_hash(key), true); }
+        // false only if key was never added
+        bool may_contain(const Slice &key) const;
+
+    private:
+        const static uint32_t LINE_BITS = 512;
+        const static uint32_t WORD_BITS = 64;
+
+        void add_hash(uint32_t h, bool concurrent);
+        uint32_t line_of(uint32_t h) const {
+            return ((h >> 11) | (h << 21)) % num_lines;  // rotated, so bits in the line stay independent
+        }
+
+        uint32_t num_lines;
+        int num_probes;
+        std::atomic<uint64_t> *data;    // num_lines cache lines
+    };
+}
+
+#endif
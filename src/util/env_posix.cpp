@@ -7,6 +7,7 @@
 #include <sys/stat.h>       // stat()
 #include <sys/time.h>       // gettimeofday()
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <atomic>
@@ -171,6 +172,59 @@ namespace stackdb {
         const std::string filename;
     };
 
+    // posix implementaion for SequentialFile, using mmap(). reads return slices into the mapping,
+    // which the kernel reads ahead of, and pages behind the read cursor are dropped as it moves on
+    class PosixMmapSequentialFile final : public SequentialFile {
+    public:
+        // takes ownership of the region as PosixMmapReadableFile, and of fd, the file mapped
+        PosixMmapSequentialFile(std::string filename, int fd, char *mmap_base, size_t len, Limiter *mmap_limiter)
+            : fd(fd), mmap_base(mmap_base), len(len), mmap_limiter(mmap_limiter), filename(filename),
+              offset(0), dropped(0) {
+            ::madvise(mmap_base, len, MADV_SEQUENTIAL);
+        }
+        ~PosixMmapSequentialFile() override {
+            ::munmap(mmap_base, len);
+            ::close(fd);
+            mmap_limiter->release();
+        }
+        // interfaces
+        Status read(size_t n, Slice *result, char *scratch) override {
+            drop_behind();
+            n = std::min(n, len - offset);
+            *result = Slice(mmap_base + offset, n);
+            offset += n;
+            return Status::OK();
+        }
+        Status skip(uint64_t n) override {
+            offset += std::min<uint64_t>(n, len - offset);
+            return Status::OK();
+        }
+    private:
+        // unmap pages before the last read, and evict them from the page cache, so reading a
+        // large file fills neither. slices into them stay valid, as the pages are read in again
+        // from the file if touched
+        void drop_behind() {
+            if (offset - dropped >= DROP_BEHIND_SIZE) {
+                size_t end = offset & ~(DROP_BEHIND_SIZE - 1);
+                ::madvise(mmap_base + dropped, end - dropped, MADV_DONTNEED);
+            #if HAVE_FADVISE
+                // unmapping alone leaves the pages cached
+                ::posix_fadvise(fd, dropped, end - dropped, POSIX_FADV_DONTNEED);
+            #endif
+                dropped = end;
+            }
+        }
+        const static size_t DROP_BEHIND_SIZE = 1 << 20;    // a multiple of page size
+
+        const int fd;
+        char *const mmap_base;
+        const size_t len;
+        Limiter *const mmap_limiter;
+        const std::string filename;
+        size_t offset;      // read cursor
+        size_t dropped;     // pages before it are dropped
+    };
+
     // posix implementation for WritableFile
     class PosixWritableFile final : public WritableFile {
     public:
@@ -222,6 +276,14 @@ namespace stackdb {
         Status flush() override {
             return flush_buffer();
         }
+        Status preallocate(uint64_t offset, uint64_t length) override {
+        #if HAVE_FALLOCATE
+            if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length) != 0) {
+                return posix_error(filename, errno);
+            }
+        #endif
+            return Status::OK();
+        }
         Status sync() override {
             // ensure new files referred by manifest are in the filesystem
             // before manifest is flushed to disk, avoiding inconsistency.
@@ -240,6 +302,14 @@ namespace stackdb {
             // sync to system buf
             return sync_to_disk(fd, filename);
         }
+        Status sync_data() override {
+            if (is_manifest) {
+                Status status = sync_dir();
+                if (!status.ok())
+                    return status;
+            }
+            return sync_to_disk(fd, filename);
+        }
 
     private:
         Status flush_buffer() {
@@ -420,6 +490,31 @@ namespace stackdb {
             return Status::OK();
         }
 
+        Status new_mmap_sequential_file(const std::string& fname, SequentialFile** result) override {
+            uint64_t file_size;
+            Status status = get_file_size(fname, &file_size);
+            // empty files can't be mapped. if no mmap() available, use normal file
+            if (!status.ok() || file_size == 0 || !mmap_limiter.acquire()) {
+                return new_sequential_file(fname, result);
+            }
+            int fd = ::open(fname.c_str(), O_RDONLY | OPEN_BASE_FLAGS);
+            if (fd < 0) {
+                mmap_limiter.release();
+                *result = nullptr;
+                return posix_error(fname, errno);
+            }
+            void *mmap_base = mmap(/*addr=*/nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mmap_base == MAP_FAILED) {
+                close(fd);
+                mmap_limiter.release();
+                *result = nullptr;
+                return posix_error(fname, errno);
+            }
+            // the file keeps fd to evict pages it has read from the page cache
+            *result = new PosixMmapSequentialFile(fname, fd, (char*)mmap_base, file_size, &mmap_limiter);
+            return Status::OK();
+        }
+
         Status new_random_access_file(const std::string& fname, RandomAccessFile** result) override {
             int fd = ::open(fname.c_str(), O_RDONLY | OPEN_BASE_FLAGS);
             if (fd < 0) {
@@ -469,6 +564,21 @@ namespace stackdb {
             return Status::OK();
         }
 
+        Status reuse_writable_file(const std::string& fname, const std::string& old_fname, WritableFile** result) override {
+            Status s = rename_file(old_fname, fname);
+            if (!s.ok()) {
+                *result = nullptr;
+                return s;
+            }
+            int fd = open(fname.c_str(), O_WRONLY | OPEN_BASE_FLAGS, 0644);     // no O_TRUNC
+            if (fd < 0) {
+                *result = nullptr;
+                return posix_error(fname, errno);
+            }
+            *result = new PosixWritableFile(fname, fd);
+            return Status::OK();
+        }
+
         bool file_exists(const std::string &fname) override {
             return access(fname.c_str(), F_OK) == 0;
         }
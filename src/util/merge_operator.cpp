@@ -0,0 +1,76 @@
+#include "stackdb/merge_operator.h"
+#include "stackdb/slice.h"
+#include "util/coding.h"
+
+namespace stackdb {
+    MergeOperator::~MergeOperator() = default;
+
+    namespace { // anonymous namespace to hide builtin merge operators
+        class UInt64AddOperator: public MergeOperator {
+        public:
+            const char *name() const override { return "stackdb.UInt64AddOperator"; }
+            bool full_merge(const Slice &key, const Slice *existing_value,
+                            const std::vector<Slice> &operands, std::string *new_value) const override {
+                uint64_t sum = 0;
+                if (existing_value != nullptr && !add(*existing_value, &sum)) return false;
+                for (const Slice &operand : operands) {
+                    if (!add(operand, &sum)) return false;
+                }
+                new_value->clear();
+                append_fixed_64(new_value, sum);
+                return true;
+            }
+            bool partial_merge(const Slice &key, const Slice &left, const Slice &right,
+                               std::string *new_value) const override {
+                uint64_t sum = 0;
+                if (!add(left, &sum) || !add(right, &sum)) return false;
+                new_value->clear();
+                append_fixed_64(new_value, sum);
+                return true;
+            }
+        private:
+            static bool add(const Slice &s, uint64_t *sum) {
+                if (s.size() != sizeof(uint64_t)) return false;
+                *sum += decode_fixed_64(s.data());
+                return true;
+            }
+        };
+
+        class StringAppendOperator: public MergeOperator {
+        public:
+            explicit StringAppendOperator(char delimiter): delimiter(delimiter) {}
+            const char *name() const override { return "stackdb.StringAppendOperator"; }
+            bool full_merge(const Slice &key, const Slice *existing_value,
+                            const std::vector<Slice> &operands, std::string *new_value) const override {
+                new_value->clear();
+                bool first = true;
+                if (existing_value != nullptr) {
+                    new_value->assign(existing_value->data(), existing_value->size());
+                    first = false;
+                }
+                for (const Slice &operand : operands) {
+                    if (!first) new_value->push_back(delimiter);
+                    new_value->append(operand.data(), operand.size());
+                    first = false;
+                }
+                return true;
+            }
+            bool partial_merge(const Slice &key, const Slice &left, const Slice &right,
+                               std::string *new_value) const override {
+                new_value->assign(left.data(), left.size());
+                new_value->push_back(delimiter);
+                new_value->append(right.data(), right.size());
+                return true;
+            }
+        private:
+            const char delimiter;
+        };
+    } // anonymous namespace
+
+    const MergeOperator *new_uint64_add_merge_operator() {
+        return new UInt64AddOperator();
+    }
+    const MergeOperator *new_string_append_merge_operator(char delimiter) {
+        return new StringAppendOperator(delimiter);
+    }
+} // namespace stackdb
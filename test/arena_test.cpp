@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cassert>
@@ -9,9 +10,9 @@ using namespace stackdb;
 // Though I don't use google test framework, I try to mimic the test contents as in original leveldb
 const int N = 100000;
 
-int main () {
+// allocate randomly sized chunks, then check none overlap. max_waste bounds mem usage over bytes used
+static void test_arena(Arena &arena, double max_waste) {
     std::vector<std::pair<size_t, char*>> allocated;
-    Arena arena;
     size_t bytes = 0;
     Random rnd(301);
 
@@ -43,7 +44,7 @@ int main () {
         allocated.push_back(std::make_pair(s, r));
         assert(arena.get_mem_usage() >= bytes);
         if (i > N / 10) {
-        assert(arena.get_mem_usage() <= bytes * 1.10);
+        assert(arena.get_mem_usage() <= bytes * max_waste);
         }
     }
     for (size_t i = 0; i < allocated.size(); i++) {
@@ -54,5 +55,105 @@ int main () {
             assert((int(p[b]) & 0xff) == i % 256);
         }
     }
+}
+
+int main () {
+    {
+        Arena arena;
+        test_arena(arena, 1.10);
+    }
+    // test growing blocks. the last block may be up to half of all memory
+    {
+        Arena arena(4096, 1024 * 1024);
+        test_arena(arena, 2.10);
+        assert(arena.get_mem_usage() >= 1024 * 1024);
+    }
+    // test huge page blocks, falling back when the system has none
+    {
+        const size_t huge_page_size = 2 * 1024 * 1024;
+        Arena arena(4096, 0, huge_page_size);
+        char *p = arena.allocate_aligned(100);
+        assert(arena.get_mem_usage() >= huge_page_size);
+        assert(((size_t)p & (sizeof(void *) - 1)) == 0);
+        // fill past the first block
+        std::vector<char *> chunks;
+        for (size_t i = 0; i < 3 * huge_page_size / 1000; i ++) {
+            chunks.push_back(arena.allocate(1000));
+            std::fill(chunks.back(), chunks.back() + 1000, i % 256);
+        }
+        for (size_t i = 0; i < chunks.size(); i ++) {
+            assert((int(chunks[i][999]) & 0xff) == i % 256);
+        }
+        assert(arena.get_mem_usage() >= 3 * huge_page_size);
+        assert(arena.get_mem_usage() <= 4 * huge_page_size + 4096);
+    }
+    // test stats
+    {
+        Arena arena;
+        ArenaStats stats = arena.get_stats();
+        assert(stats.allocated_bytes == 0 && stats.used_bytes == 0);
+
+        arena.allocate(1);
+        arena.allocate_aligned(8);      // 7 bytes of padding
+        stats = arena.get_stats();
+        assert(stats.allocated_bytes == 4096);
+        assert(stats.used_bytes == 9);
+        assert(stats.alignment_padding_bytes == 7);
+        assert(stats.wasted_tail_bytes == 0);
+        assert(stats.unused_bytes() == 4096 - 16);
+        assert(stats.size_histogram[0] == 1 && stats.size_histogram[3] == 1);
+
+        for (int i = 0; i < 5; i ++) {
+            arena.allocate(1000);       // the 5th doesn't fit in the 80 bytes left, so they are wasted
+        }
+        arena.allocate(5000);           // a block of its own, wasting nothing
+        stats = arena.get_stats();
+        assert(stats.allocated_bytes == 4096 * 2 + 5000);
+        assert(stats.used_bytes == 9 + 5000 + 5000);
+        assert(stats.wasted_tail_bytes == 80);
+        assert(stats.unused_bytes() == 4096 - 1000);
+        assert(stats.size_histogram[9] == 5 && stats.size_histogram[12] == 1);
+        assert(!stats.to_string().empty());
+    }
+    // test stats add up after random allocations
+    {
+        Arena arena;
+        test_arena(arena, 1.10);
+        ArenaStats stats = arena.get_stats();
+        uint64_t count = 0;
+        for (int i = 0; i < ArenaStats::HISTOGRAM_BUCKETS; i ++) {
+            count += stats.size_histogram[i];
+        }
+        assert(count == N);
+        assert(stats.allocated_bytes <= arena.get_mem_usage());
+        assert(stats.unused_bytes() < 4096);
+    }
+    // test blocks recycled through a pool
+    {
+        ArenaBlockPool pool(64 * 1024);
+        {
+            Arena arena(4096, 0, 0, &pool);
+            arena.allocate(100);
+            for (int i = 0; i < 100; i ++) {
+                arena.allocate(1000);   // about 25 blocks, more than the pool keeps
+            }
+        }
+        assert(pool.get_retained_bytes() <= 64 * 1024);
+        assert(pool.get_retained_bytes() >= 64 * 1024 - 4096);
+        {
+            Arena arena(4096, 0, 0, &pool);
+            size_t retained = pool.get_retained_bytes();
+            arena.allocate(100);
+            assert(pool.get_retained_bytes() == retained - 4096);
+            test_arena(arena, 1.10);
+        }
+        // blocks of other sizes are not taken
+        {
+            Arena arena(8192, 0, 0, &pool);
+            size_t retained = pool.get_retained_bytes();
+            arena.allocate(100);
+            assert(pool.get_retained_bytes() == retained);
+        }
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <cassert>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "util/concurrent_arena.h"
+#include "util/random.h"
+using namespace stackdb;
+
+// allocations from many threads don't overlap, and get_mem_usage() stays close to the bytes used
+static void test_threads(int num_threads) {
+    const int N = 20000;
+    ConcurrentArena arena;
+    std::vector<std::vector<std::pair<size_t, char *>>> allocated(num_threads);
+    std::vector<size_t> bytes(num_threads, 0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t ++) {
+        threads.emplace_back([&, t]() {
+            Random rnd(301 + t);
+            for (int i = 0; i < N; i ++) {
+                size_t s = rnd.one_in(1000) ? rnd.uniform(6000) + 1
+                         : (rnd.one_in(10) ? rnd.uniform(100) + 1 : rnd.uniform(20) + 1);
+                char *r = rnd.one_in(2) ? arena.allocate_aligned_concurrently(s)
+                                        : arena.allocate_concurrently(s);
+                for (size_t b = 0; b < s; b ++) {
+                    r[b] = (i + t) % 256;
+                }
+                bytes[t] += s;
+                allocated[t].push_back(std::make_pair(s, r));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    size_t total = 0;
+    for (int t = 0; t < num_threads; t ++) {
+        for (int i = 0; i < N; i ++) {
+            size_t s = allocated[t][i].first;
+            const char *p = allocated[t][i].second;
+            for (size_t b = 0; b < s; b ++) {
+                assert((int(p[b]) & 0xff) == (i + t) % 256);
+            }
+        }
+        total += bytes[t];
+    }
+    assert(arena.get_mem_usage() >= total);
+    ArenaStats stats = arena.get_stats();
+    assert(stats.used_bytes == total);
+    assert(stats.allocated_bytes >= total + stats.alignment_padding_bytes + stats.wasted_tail_bytes);
+    assert(stats.unused_bytes() <= size_t(num_threads) * 8 * 1024 + 4096);
+    uint64_t count = 0;
+    for (int i = 0; i < ArenaStats::HISTOGRAM_BUCKETS; i ++) {
+        count += stats.size_histogram[i];
+    }
+    assert(count == uint64_t(N) * num_threads);
+    assert(arena.get_mem_usage() <= total * 1.10 + num_threads * 8 * 1024);
+}
+
+int main() {
+    // test plain and concurrent allocations mixed from one thread
+    {
+        ConcurrentArena arena;
+        char *a = arena.allocate(10);
+        char *b = arena.allocate_concurrently(10);
+        char *c = arena.allocate_aligned_concurrently(10);
+        assert(a != b && b != c && a != c);
+        assert((reinterpret_cast<size_t>(c) & (sizeof(void *) - 1)) == 0);
+        assert(arena.get_mem_usage() >= 30);
+    }
+    // test shards of different arenas in one thread don't mix
+    {
+        ConcurrentArena a1, a2;
+        char *p1 = a1.allocate_concurrently(100);
+        char *p2 = a2.allocate_concurrently(100);
+        char *q1 = a1.allocate_concurrently(100);
+        assert(q1 == p1 + 100);
+        assert(p2 < p1 || p2 >= q1 + 100);
+    }
+    // test chunks given up to an arena sharing the shard slot are counted as wasted
+    {
+        const int NUM_ARENAS = 9;
+        std::vector<std::unique_ptr<ConcurrentArena>> arenas;
+        for (int i = 0; i < NUM_ARENAS; i ++) {
+            arenas.emplace_back(new ConcurrentArena());
+        }
+        for (int round = 0; round < 100; round ++) {
+            for (auto &arena : arenas) {
+                arena->allocate_concurrently(100);
+            }
+        }
+        for (auto &arena : arenas) {
+            ArenaStats stats = arena->get_stats();
+            assert(stats.used_bytes == 100 * 100);
+            assert(stats.wasted_tail_bytes > 0);
+            // only the chunk still in a shard, if any, and the rest of the arena's block are unused
+            assert(stats.unused_bytes() <= 8 * 1024 + 4096);
+        }
+    }
+    // test shard chunks come from regular blocks, which grow and may be huge page backed
+    {
+        ArenaBlockPool pool(16 * 1024 * 1024);
+        {
+            ConcurrentArena arena(4096, 64 * 1024, 0, &pool);
+            for (int i = 0; i < 100000; i ++) {
+                arena.allocate_concurrently(10);
+            }
+        }
+        ArenaBlock block;
+        assert(pool.take(64 * 1024, &block));   // grew up to max_block_size
+        block.free();
+
+        ConcurrentArena huge(4096, 0, 2 * 1024 * 1024);
+        huge.allocate_aligned_concurrently(10);
+        assert(huge.get_mem_usage() >= 2 * 1024 * 1024);
+    }
+    for (int num_threads = 1; num_threads <= 8; num_threads *= 2) {
+        test_threads(num_threads);
+    }
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include <cstring>
+#include <string>
+#include <algorithm>
 #include <cassert>
 #include "util/crc32c.h"
+#include "util/random.h"
 using namespace stackdb::crc32c;
 
 int main() {
@@ -49,4 +52,60 @@ int main() {
         assert(unmask(mask(crc)) == crc);
         assert(unmask(unmask(mask(mask(crc)))) == crc);
     }
+    // test portable and accelerated paths agree, over all small lengths and alignments
+    {
+        if (is_accelerated()) {
+            stackdb::Random rnd(301);
+            char buf[1024 + 8];
+            for (size_t i = 0; i < sizeof(buf); i++) {
+                buf[i] = static_cast<char>(rnd.uniform(256));
+            }
+            for (size_t offset = 0; offset < 8; offset++) {
+                for (size_t n = 0; n <= 1024; n++) {
+                    uint32_t init = rnd.next();
+                    assert(extend_portable(init, buf + offset, n) ==
+                           extend_accelerated(init, buf + offset, n));
+                }
+            }
+            assert(extend_accelerated(0, "hello world", 11) == value("hello world", 11));
+        }
+    }
+    // test large buffers that go through the folding kernel
+    {
+        if (is_accelerated()) {
+            stackdb::Random rnd(302);
+            std::string buf(256 * 1024 + 8, '\0');
+            for (size_t i = 0; i < buf.size(); i++) {
+                buf[i] = static_cast<char>(rnd.uniform(256));
+            }
+            for (int i = 0; i < 200; i++) {
+                size_t offset = rnd.uniform(8);
+                size_t n = rnd.uniform(256 * 1024);
+                uint32_t init = rnd.next();
+                assert(extend_portable(init, buf.data() + offset, n) ==
+                       extend_accelerated(init, buf.data() + offset, n));
+            }
+        }
+    }
+    // test combine
+    {
+        assert(combine(value("hello ", 6), value("world", 5), 5) == value("hello world", 11));
+        assert(combine(value("hello world", 11), value("", 0), 0) == value("hello world", 11));
+        assert(combine(value("", 0), value("hello world", 11), 11) == value("hello world", 11));
+
+        // checksum a 32KB block in chunks and merge the chunk results
+        stackdb::Random rnd(303);
+        std::string block(32 * 1024, '\0');
+        for (size_t i = 0; i < block.size(); i++) {
+            block[i] = static_cast<char>(rnd.uniform(256));
+        }
+        for (size_t chunk : {1, 7, 4096, 10000, 32 * 1024}) {
+            uint32_t crc = value("", 0);
+            for (size_t pos = 0; pos < block.size(); pos += chunk) {
+                size_t len = std::min(chunk, block.size() - pos);
+                crc = combine(crc, value(block.data() + pos, len), len);
+            }
+            assert(crc == value(block.data(), block.size()));
+        }
+    }
 }
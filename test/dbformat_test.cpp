@@ -92,6 +92,22 @@ int main() {
         assert(internal_key("\xff\xff", 100, ValType::VALUE) ==
             short_successor(internal_key("\xff\xff", 100, ValType::VALUE)));
     }
+    // test inlined bytewise compare agrees with InternalKeyComparator
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        const std::string keys[] = {
+            internal_key("", 1, ValType::VALUE), internal_key("", 2, ValType::DELETION),
+            internal_key("a", 1, ValType::VALUE), internal_key("a", 1, ValType::DELETION),
+            internal_key("a", 100, ValType::VALUE), internal_key(std::string("a\0", 2), 1, ValType::VALUE),
+            internal_key("ab", MAX_SEQ_NUM, ValType::SEEK), internal_key("\xff", 1, ValType::VALUE)};
+        for (const std::string &a : keys) {
+            for (const std::string &b : keys) {
+                assert(compare_internal_keys(BytewiseCompare(), a, b) == cmp.compare(a, b));
+            }
+        }
+        assert(compare_internal_keys(BytewiseCompare(), internal_key("a", 100, ValType::VALUE),
+                                     internal_key("a", 1, ValType::VALUE)) < 0);
+    }
     // test parsed internal key debug string
     {
         ParsedInternalKey key("The \"key\" in 'single quotes'", 42, ValType::VALUE);
@@ -0,0 +1,64 @@
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "util/coding.h"
+#include "util/dynamic_bloom.h"
+using namespace stackdb;
+
+static Slice key(int i, char *buffer) {
+    encode_fixed_32(buffer, i);
+    return Slice(buffer, sizeof(int));
+}
+
+int main() {
+    // test empty filter
+    {
+        Arena arena;
+        DynamicBloom bloom(&arena, 100);
+        char buffer[sizeof(int)];
+        assert(!bloom.may_contain("hello"));
+        assert(!bloom.may_contain(""));
+        assert(!bloom.may_contain(key(0, buffer)));
+    }
+    // test added keys always match and false positive rate is low, at 10 bits per key
+    for (int n = 1; n <= 100000; n *= 10) {
+        Arena arena;
+        DynamicBloom bloom(&arena, n * 10);
+        char buffer[sizeof(int)];
+        for (int i = 0; i < n; i ++) {
+            bloom.add(key(i, buffer));
+        }
+        for (int i = 0; i < n; i ++) {
+            assert(bloom.may_contain(key(i, buffer)));
+        }
+        int false_positives = 0;
+        for (int i = 0; i < 10000; i ++) {
+            if (bloom.may_contain(key(i + 1000000000, buffer))) false_positives ++;
+        }
+        assert(false_positives < 10000 * 0.03);
+    }
+    // test concurrent add
+    {
+        const int N = 100000;
+        const int num_threads = 4;
+        Arena arena;
+        DynamicBloom bloom(&arena, N * 10);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < num_threads; t ++) {
+            writers.emplace_back([&bloom, t]() {
+                char buffer[sizeof(int)];
+                for (int i = t; i < N; i += num_threads) {
+                    bloom.add_concurrently(key(i, buffer));
+                }
+            });
+        }
+        for (auto &writer : writers) {
+            writer.join();
+        }
+        char buffer[sizeof(int)];
+        for (int i = 0; i < N; i ++) {
+            assert(bloom.may_contain(key(i, buffer)));
+        }
+    }
+    return 0;
+}
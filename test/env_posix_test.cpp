@@ -1,4 +1,6 @@
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
 
@@ -148,6 +150,76 @@ int main(int argc, char *argv[]) {
         }
         assert(env->remove_file(test_file).ok());
     }
+    // test reuse writable file keeps old contents past new writes, and preallocate keeps size
+    {
+        std::string test_dir;
+        assert(env->get_test_dir(&test_dir).ok());
+        std::string old_file = test_dir + "/reuse_old.log";
+        std::string new_file = test_dir + "/reuse_new.log";
+        assert(write_string_to_file(env, "0123456789", old_file).ok());
+
+        WritableFile *file = nullptr;
+        assert(env->reuse_writable_file(new_file, old_file, &file).ok());
+        assert(!env->file_exists(old_file));
+        assert(file->preallocate(0, 1 << 20).ok());
+        assert(file->append("abc").ok());
+        assert(file->close().ok());
+        delete file;
+
+        std::string data;
+        assert(read_file_to_string(env, new_file, &data).ok());
+        assert(data == "abc3456789");
+        assert(env->remove_file(new_file).ok());
+    }
+    // test mmap sequential file returns slices into the mapping, across dropped pages
+    {
+        std::string test_dir;
+        assert(env->get_test_dir(&test_dir).ok());
+        std::string file_path = test_dir + "/mmap_sequential.txt";
+        std::string file_data;
+        for (int i = 0; file_data.size() < (3 << 20); i ++) {
+            file_data.append(std::to_string(i));
+        }
+        // synced, as only clean pages can be evicted from the page cache
+        assert(write_string_to_file_sync(env, file_data, file_path).ok());
+
+        SequentialFile *file = nullptr;
+        assert(env->new_mmap_sequential_file(file_path, &file).ok());
+        char scratch[4096];
+        Slice result;
+        std::string read_data;
+        assert(file->skip(100).ok());
+        while (file->read(sizeof(scratch), &result, scratch).ok() && !result.empty()) {
+            assert(result.data() != scratch);
+            read_data.append(result.data(), result.size());
+        }
+        assert(read_data == file_data.substr(100));
+        delete file;
+#if HAVE_FADVISE
+        // pages read past are dropped from the page cache, not just unmapped
+        {
+            int fd = ::open(file_path.c_str(), O_RDONLY);
+            const size_t dropped_size = 1 << 20;
+            void *base = ::mmap(nullptr, dropped_size, PROT_READ, MAP_SHARED, fd, 0);
+            assert(base != MAP_FAILED);
+            const size_t page_size = ::sysconf(_SC_PAGESIZE);
+            std::vector<unsigned char> resident(dropped_size / page_size);
+            assert(::mincore(base, dropped_size, resident.data()) == 0);
+            size_t resident_pages = 0;
+            for (unsigned char r : resident) resident_pages += r & 1;
+            assert(resident_pages < resident.size() / 4);
+            ::munmap(base, dropped_size);
+            ::close(fd);
+        }
+#endif
+
+        // empty files are read normally
+        assert(write_string_to_file(env, "", file_path).ok());
+        assert(env->new_mmap_sequential_file(file_path, &file).ok());
+        assert(file->read(sizeof(scratch), &result, scratch).ok() && result.empty());
+        delete file;
+        assert(env->remove_file(file_path).ok());
+    }
 
 #if HAVE_O_CLOEXEC
     // test close on sequential file
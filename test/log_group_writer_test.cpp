@@ -0,0 +1,103 @@
+#include <atomic>
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stackdb/env.h"
+#include "db/log_group_writer.h"
+#include "db/log_reader.h"
+using namespace stackdb;
+using namespace stackdb::log;
+
+// in-memory file counting syncs. only a leader uses it at a time
+class StringDest : public WritableFile {
+public:
+    StringDest() : syncs(0), fail_sync(false) {}
+    Status close() override { return Status::OK(); }
+    Status flush() override { return Status::OK(); }
+    Status sync() override {
+        syncs ++;
+        return fail_sync ? Status::IOError("sync failed") : Status::OK();
+    }
+    Status append(const Slice& slice) override {
+        contents.append(slice.data(), slice.size());
+        return Status::OK();
+    }
+    std::string contents;
+    int syncs;
+    bool fail_sync;
+};
+
+class StringSource : public SequentialFile {
+public:
+    explicit StringSource(const std::string &contents) : contents(contents) {}
+    Status read(size_t n, Slice* result, char* scratch) override {
+        n = std::min(n, contents.size());
+        *result = Slice(contents.data(), n);
+        contents.remove_prefix(n);
+        return Status::OK();
+    }
+    Status skip(uint64_t n) override {
+        contents.remove_prefix(std::min(n, static_cast<uint64_t>(contents.size())));
+        return Status::OK();
+    }
+    Slice contents;
+};
+
+static std::string record_of(int thread, int i) {
+    // some records span blocks
+    std::string record = std::to_string(thread) + "." + std::to_string(i) + ".";
+    record.resize(i % 50 == 0 ? 3 * BLOCK_SIZE : 100 + i % 100, 'x');
+    return record;
+}
+
+// records of all writers are read back once, each writer's in order
+static void test_threads(int num_threads) {
+    const int N = 500;
+    StringDest dest;
+    Writer writer(&dest);
+    GroupWriter group_writer(&writer);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t ++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < N; i ++) {
+                assert(group_writer.add_record(record_of(t, i), i % 2 == 0).ok());
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    assert(dest.syncs > 0 && dest.syncs <= num_threads * N / 2);
+
+    StringSource source(dest.contents);
+    Reader reader(&source, nullptr, true, 0);
+    std::vector<int> next(num_threads, 0);
+    Slice record;
+    std::string scratch;
+    int count = 0;
+    while (reader.read_record(&record, &scratch)) {
+        int t = std::stoi(record.to_string());
+        assert(t >= 0 && t < num_threads && next[t] < N);
+        assert(record.to_string() == record_of(t, next[t]));
+        next[t] ++;
+        count ++;
+    }
+    assert(count == num_threads * N);
+}
+
+int main() {
+    for (int num_threads : {1, 2, 8, 32}) {
+        test_threads(num_threads);
+    }
+    // test a failed sync fails the record
+    {
+        StringDest dest;
+        Writer writer(&dest);
+        GroupWriter group_writer(&writer);
+        assert(group_writer.add_record("a", true).ok());
+        dest.fail_sync = true;
+        assert(group_writer.add_record("b", false).ok());
+        assert(group_writer.add_record("c", true).is_io_error());
+    }
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "stackdb/env.h"
+#include "db/log_parallel_reader.h"
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "util/random.h"
+
+using namespace stackdb;
+using namespace stackdb::log;
+
+class StringDest : public WritableFile {
+public:
+    Status close() override { return Status::OK(); }
+    Status flush() override { return Status::OK(); }
+    Status sync() override { return Status::OK(); }
+    Status append(const Slice& slice) override {
+        contents.append(slice.data(), slice.size());
+        return Status::OK();
+    }
+    std::string contents;
+};
+
+class StringSource : public SequentialFile {
+public:
+    explicit StringSource(const Slice &contents) : contents(contents) {}
+    Status read(size_t n, Slice* result, char* scratch) override {
+        n = std::min(n, contents.size());
+        *result = Slice(contents.data(), n);
+        contents.remove_prefix(n);
+        return Status::OK();
+    }
+    Status skip(uint64_t n) override {
+        contents.remove_prefix(std::min<uint64_t>(n, contents.size()));
+        return Status::OK();
+    }
+    Slice contents;
+};
+
+class StringRandomSource : public RandomAccessFile {
+public:
+    explicit StringRandomSource(const std::string &contents) : contents(contents) {}
+    Status read(uint64_t offset, size_t n, Slice* result, char* scratch) const override {
+        if (offset > contents.size()) {
+            return Status::IOError("read past end");
+        }
+        n = std::min<size_t>(n, contents.size() - offset);
+        *result = Slice(contents.data() + offset, n);
+        return Status::OK();
+    }
+    const std::string &contents;
+};
+
+class FailingSource : public StringRandomSource {
+public:
+    FailingSource(const std::string &contents, uint64_t fail_offset)
+        : StringRandomSource(contents), fail_offset(fail_offset) {}
+    Status read(uint64_t offset, size_t n, Slice* result, char* scratch) const override {
+        if (offset >= fail_offset) {
+            return Status::IOError("read failed");
+        }
+        return StringRandomSource::read(offset, n, result, scratch);
+    }
+    const uint64_t fail_offset;
+};
+
+class ReportCollector : public Reader::Reporter {
+public:
+    void corruption(size_t bytes, const Status& status) override {
+        reports.push_back(std::to_string(bytes) + " " + status.to_string());
+    }
+    std::vector<std::string> reports;
+};
+
+// records, their offsets and corruption reports read from a log
+struct ReadResult {
+    std::vector<std::string> records;
+    std::vector<uint64_t> offsets;
+    std::vector<std::string> reports;
+    bool operator==(const ReadResult &o) const {
+        return records == o.records && offsets == o.offsets && reports == o.reports;
+    }
+};
+
+static void read_all(Reader *reader, ReadResult *result) {
+    Slice record;
+    std::string scratch;
+    while (reader->read_record(&record, &scratch)) {
+        result->records.push_back(record.to_string());
+        result->offsets.push_back(reader->get_last_record_offset());
+    }
+    assert(!reader->read_record(&record, &scratch));    // stays at the end
+}
+
+static ReadResult read_sequential(const std::string &contents, uint64_t log_number = 0) {
+    ReadResult result;
+    StringSource source(contents);
+    ReportCollector reporter;
+    Reader reader(&source, &reporter, true /*checksum*/, 0 /*init_offset*/, log_number);
+    read_all(&reader, &result);
+    result.reports = reporter.reports;
+    return result;
+}
+
+static ReadResult read_parallel(const std::string &contents, int num_threads, uint64_t log_number = 0) {
+    ReadResult result;
+    StringRandomSource source(contents);
+    ReportCollector reporter;
+    ParallelReader reader(&source, contents.size(), &reporter, true /*checksum*/, num_threads, log_number);
+    read_all(&reader, &result);
+    result.reports = reporter.reports;
+    return result;
+}
+
+static void check_same(const std::string &contents, uint64_t log_number = 0) {
+    ReadResult expected = read_sequential(contents, log_number);
+    for (int num_threads : {1, 2, 4}) {
+        assert(read_parallel(contents, num_threads, log_number) == expected);
+    }
+}
+
+static std::string write_log(const std::vector<std::string> &records, uint64_t log_number = 0) {
+    StringDest dest;
+    WriterOptions options;
+    options.log_number = log_number;
+    Writer writer(&dest, options);
+    for (auto &record : records) {
+        writer.add_record(record);
+    }
+    return dest.contents;
+}
+
+// records of up to 3 blocks, so some span chunk edges
+static std::vector<std::string> random_records(Random &rnd, int n) {
+    std::vector<std::string> records;
+    for (int i = 0; i < n; i ++) {
+        records.push_back(std::string(rnd.skewed(17) % (3 * BLOCK_SIZE), static_cast<char>('a' + i % 26)));
+    }
+    return records;
+}
+
+int main() {
+    Random rnd(301);
+    const std::vector<std::string> records = random_records(rnd, 500);
+    const std::string log = write_log(records);
+    assert(log.size() > 4 * 16 * BLOCK_SIZE);   // several chunks
+
+    // empty, intact and truncated logs
+    check_same("");
+    check_same(log);
+    assert(read_parallel(log, 4).records == records);
+    assert(read_parallel(log, 4).reports.empty());
+    check_same(log.substr(0, log.size() - 3));
+    check_same(log.substr(0, 16 * BLOCK_SIZE));             // ends at a chunk edge
+    check_same(log.substr(0, 16 * BLOCK_SIZE + 5));         // a partial header past the edge
+
+    // corrupted payloads, lengths and types, near and away from chunk edges
+    for (int i = 0; i < 20; i ++) {
+        std::string corrupted = log;
+        for (int j = 0; j < 3; j ++) {
+            size_t offset = rnd.uniform(static_cast<int>(corrupted.size()));
+            if (j == 0) {
+                offset = (rnd.uniform(4) + 1) * 16 * BLOCK_SIZE + rnd.uniform(8);
+            }
+            corrupted[offset] ^= 1 << rnd.uniform(8);
+        }
+        check_same(corrupted);
+    }
+
+    // a recyclable log, read from a file reused from an older one
+    const std::string old_log = write_log(records, 1);
+    std::string reused = old_log;
+    const std::string new_log = write_log(random_records(rnd, 200), 2);
+    reused.replace(0, new_log.size(), new_log);
+    check_same(reused, 2);
+    assert(read_parallel(reused, 4, 2).records.size() == 200);
+    // broken records in it, reported unless in the last block of the log. one at a chunk edge
+    assert(new_log.size() > 2 * 16 * BLOCK_SIZE);
+    for (size_t offset : std::vector<size_t>{BLOCK_SIZE + 100, 16 * BLOCK_SIZE + 3, new_log.size() - 1}) {
+        std::string corrupted = reused;
+        corrupted[offset] ^= 1;
+        check_same(corrupted, 2);
+        assert(read_parallel(corrupted, 4, 2).reports.empty() == (offset == new_log.size() - 1));
+    }
+    for (int i = 0; i < 20; i ++) {
+        std::string corrupted = reused;
+        corrupted[rnd.uniform(static_cast<int>(new_log.size()))] ^= 1 << rnd.uniform(8);
+        check_same(corrupted, 2);
+    }
+
+    // a read error ends the log, with the block dropped
+    {
+        FailingSource source(log, 2 * 16 * BLOCK_SIZE);
+        ReportCollector reporter;
+        ParallelReader reader(&source, log.size(), &reporter, true, 2);
+        ReadResult result;
+        read_all(&reader, &result);
+        assert(!result.records.empty() && result.records.size() < records.size());
+        assert(std::equal(result.records.begin(), result.records.end(), records.begin()));
+        assert(reporter.reports.size() == 1);
+        assert(reporter.reports[0] == std::to_string(BLOCK_SIZE) + " IO error: read failed");
+    }
+    // the caller stops early
+    {
+        StringRandomSource source(log);
+        ParallelReader reader(&source, log.size(), nullptr, true, 4);
+        Slice record;
+        std::string scratch;
+        assert(reader.read_record(&record, &scratch));
+        assert(record.to_string() == records[0]);
+    }
+    return 0;
+}
@@ -1,3 +1,9 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include "stackdb/env.h"
 #include "db/dbformat.h"
 #include "db/log_reader.h"
@@ -52,6 +58,15 @@ public:
     }
     size_t written_bytes() const { return dest.contents.size(); }      
 
+    bool read_record(Slice *record, std::string *scratch) {
+        if (!reading) {
+            reading = true;
+            source.contents = Slice(dest.contents);
+        }
+        return reader->read_record(record, scratch);
+    }
+    const char *contents_data() const { return dest.contents.data(); }
+
     std::string read() {
         if (!reading) {
             reading = true;
@@ -222,7 +237,235 @@ uint64_t LogTest::initial_offset_last_record_offsets[] = {
 int LogTest::num_initial_offset_records =
     sizeof(LogTest::initial_offset_last_record_offsets) / sizeof(uint64_t);
 
+// counts flushes and syncs of a writer, which may come from its background thread
+class CountingDest : public WritableFile {
+public:
+    CountingDest() : flushes(0), syncs(0), fail_sync(false), preallocated(0) {}
+    Status close() override { return Status::OK(); }
+    Status flush() override { flushes ++; return Status::OK(); }
+    Status sync() override {
+        syncs ++;
+        return fail_sync ? Status::IOError("sync failed") : Status::OK();
+    }
+    Status append(const Slice& slice) override { return Status::OK(); }
+    Status preallocate(uint64_t offset, uint64_t length) override {
+        assert(offset == preallocated);     // reserved back to back
+        preallocated += length;
+        return Status::OK();
+    }
+    std::atomic<int> flushes;
+    std::atomic<int> syncs;
+    std::atomic<bool> fail_sync;
+    uint64_t preallocated;
+};
+
+// test flushes and syncs follow WriterOptions
+static void test_writer_options() {
+    const std::string record(100, 'x');
+    {   // flush every record by default
+        CountingDest dest;
+        Writer writer(&dest);
+        for (int i = 0; i < 10; i ++) writer.add_record(record);
+        assert(dest.flushes == 10 && dest.syncs == 0);
+    }
+    {   // flush every flush_bytes
+        CountingDest dest;
+        WriterOptions options;
+        options.flush_bytes = 1000;
+        Writer writer(&dest, options);
+        for (int i = 0; i < 95; i ++) writer.add_record(record);
+        assert(dest.flushes == 9);
+        assert(writer.flush().ok() && dest.flushes == 10);
+    }
+    {   // flush in background only
+        CountingDest dest;
+        WriterOptions options;
+        options.flush_interval_micros = 1000;
+        {
+            Writer writer(&dest, options);
+            for (int i = 0; i < 100; i ++) writer.add_record(record);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            assert(dest.flushes >= 1 && dest.flushes < 100);
+            int flushes = dest.flushes;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            assert(dest.flushes == flushes);    // nothing new to flush
+            writer.add_record(record);
+        }
+        assert(dest.syncs == 0);
+    }
+    {   // sync in background, and report its error
+        CountingDest dest;
+        WriterOptions options;
+        options.sync_interval_millis = 5;
+        Writer writer(&dest, options);
+        writer.add_record(record);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        assert(dest.syncs == 1);
+        dest.fail_sync = true;
+        assert(writer.add_record(record).ok());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        assert(dest.syncs == 2);
+        assert(writer.add_record(record).is_io_error());
+    }
+}
+
+// a dest whose sync_data() waits until released, to test records can be added during a sync
+class SlowSyncDest : public WritableFile {
+public:
+    SlowSyncDest() : appends(0), syncing(false), released(false) {}
+    Status close() override { return Status::OK(); }
+    Status flush() override { return Status::OK(); }
+    Status sync() override { return Status::OK(); }
+    Status sync_data() override {
+        syncing = true;
+        while (!released) std::this_thread::yield();
+        syncing = false;
+        return Status::OK();
+    }
+    Status append(const Slice& slice) override { appends ++; return Status::OK(); }
+    std::atomic<int> appends;
+    std::atomic<bool> syncing;
+    std::atomic<bool> released;
+};
+
+// test syncs don't hold off records added meanwhile, from sync() or the background thread
+static void test_sync_unlocked() {
+    const std::string record(100, 'x');
+    for (bool background : {false, true}) {
+        SlowSyncDest dest;
+        WriterOptions options;
+        options.sync_interval_millis = background ? 1 : 0;
+        Writer writer(&dest, options);
+        writer.add_record(record);
+        std::thread syncer;
+        if (!background) {
+            syncer = std::thread([&writer] { assert(writer.sync().ok()); });
+        }
+        while (!dest.syncing) std::this_thread::yield();
+        int appends = dest.appends;
+        assert(writer.add_record(record).ok());     // would wait for the sync with it under the lock
+        assert(dest.appends > appends && dest.syncing);
+        dest.released = true;
+        if (syncer.joinable()) syncer.join();
+    }
+}
+
+// test space is reserved ahead of appends by preallocate_size
+static void test_preallocate() {
+    CountingDest dest;
+    WriterOptions options;
+    options.preallocate_size = 4096;
+    Writer writer(&dest, options);
+    writer.add_record(std::string(100, 'x'));
+    assert(dest.preallocated == 4096);
+    for (int i = 0; i < 99; i ++) writer.add_record(std::string(100, 'x'));
+    assert(dest.preallocated == 12288);     // 100 * (HEADER_SIZE + 100) bytes written
+}
+
+class StringFile : public WritableFile {
+public:
+    Status close() override { return Status::OK(); }
+    Status flush() override { return Status::OK(); }
+    Status sync() override { return Status::OK(); }
+    Status append(const Slice& slice) override {
+        contents.append(slice.data(), slice.size());
+        return Status::OK();
+    }
+    std::string contents;
+};
+
+class SliceSource : public SequentialFile {
+public:
+    explicit SliceSource(const Slice &contents) : contents(contents) {}
+    Status read(size_t n, Slice* result, char* scratch) override {
+        n = std::min(n, contents.size());
+        *result = Slice(contents.data(), n);
+        contents.remove_prefix(n);
+        return Status::OK();
+    }
+    Status skip(uint64_t n) override {
+        contents.remove_prefix(std::min<uint64_t>(n, contents.size()));
+        return Status::OK();
+    }
+    Slice contents;
+};
+
+class DropCounter : public Reader::Reporter {
+public:
+    DropCounter() : dropped_bytes(0) {}
+    void corruption(size_t bytes, const Status& status) override { dropped_bytes += bytes; }
+    size_t dropped_bytes;
+};
+
+static std::string write_log(uint64_t log_number, const std::vector<std::string> &records) {
+    StringFile dest;
+    WriterOptions options;
+    options.log_number = log_number;
+    Writer writer(&dest, options);
+    for (auto &record : records) writer.add_record(record);
+    return dest.contents;
+}
+
+static std::vector<std::string> read_log(const std::string &contents, uint64_t log_number, size_t *dropped_bytes) {
+    SliceSource source(contents);
+    DropCounter reporter;
+    Reader reader(&source, &reporter, true /*checksum*/, 0 /*initial_offset*/, log_number);
+    std::vector<std::string> records;
+    Slice record;
+    std::string scratch;
+    while (reader.read_record(&record, &scratch)) {
+        records.push_back(record.to_string());
+    }
+    *dropped_bytes = reporter.dropped_bytes;
+    return records;
+}
+
+// test the recyclable format, and reading a log from a file reused from an older log
+static void test_recyclable_log() {
+    Random rnd(301);
+    std::vector<std::string> old_records, new_records;
+    for (int i = 0; i < 1000; i ++) old_records.push_back(random_skewed_string(i, rnd));
+    for (int i = 0; i < 300; i ++) new_records.push_back(random_skewed_string(i + 1000, rnd));
+    size_t dropped_bytes;
+
+    // round trip, including records that span blocks
+    const std::string old_log = write_log(7, old_records);
+    assert(read_log(old_log, 7, &dropped_bytes) == old_records && dropped_bytes == 0);
+    assert(read_log(old_log, 0, &dropped_bytes) == old_records && dropped_bytes == 0);
+    // a reader expecting another log reads nothing
+    assert(read_log(old_log, 8, &dropped_bytes).empty() && dropped_bytes == 0);
+
+    // the new log overwrites the start of the old one, and reading stops where it ends
+    const std::string new_log = write_log(8, new_records);
+    assert(new_log.size() < old_log.size());
+    std::string reused = old_log;
+    reused.replace(0, new_log.size(), new_log);
+    assert(read_log(reused, 8, &dropped_bytes) == new_records && dropped_bytes == 0);
+
+    // a broken record followed by more of the log is reported, and reading goes on past it
+    assert(new_log.size() > 3 * BLOCK_SIZE);
+    std::string corrupted = reused;
+    corrupted[BLOCK_SIZE + 100] ^= 1;
+    std::vector<std::string> records = read_log(corrupted, 8, &dropped_bytes);
+    assert(dropped_bytes > 0 && records.size() < new_records.size() && records.back() == new_records.back());
+    // one in the last block of the log is where it ends, as if the writer died writing it
+    corrupted = reused;
+    corrupted[new_log.size() - 1] ^= 1;
+    records = read_log(corrupted, 8, &dropped_bytes);
+    assert(dropped_bytes == 0 && records.size() < new_records.size());
+    assert(std::equal(records.begin(), records.end(), new_records.begin()));
+
+    // same for a legacy log left in the file
+    std::string legacy_log = write_log(0, old_records);
+    legacy_log.replace(0, new_log.size(), new_log);
+    assert(read_log(legacy_log, 8, &dropped_bytes) == new_records && dropped_bytes == 0);
+}
+
 int main() {
+    test_writer_options();
+    test_sync_unlocked();
+    test_preallocate();
+    test_recyclable_log();
     // suppress used warning
     Random rnd(1);
     random_skewed_string(1, rnd);
@@ -246,6 +489,18 @@ int main() {
         assert(logger.read() == "EOF");
         assert(logger.read() == "EOF");  // Make sure reads at eof work
     }
+    // test records that aren't fragmented are not copied, if the file returns slices into its own memory
+    {
+        LogTest logger;
+        logger.write("foo");
+        logger.write(big_string("bar", 2 * BLOCK_SIZE));
+        std::string scratch;
+        Slice record;
+        assert(logger.read_record(&record, &scratch) && record.to_string() == "foo");
+        assert(scratch.empty() && record.data() >= logger.contents_data()
+                && record.data() < logger.contents_data() + logger.written_bytes());
+        assert(logger.read_record(&record, &scratch) && record.data() == scratch.data());
+    }
     // test many blocks
     {
         LogTest logger;
@@ -0,0 +1,860 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/memtable.h"
+#include "stackdb/comparator.h"
+#include "util/random.h"
+using namespace stackdb;
+
+static std::string number_key(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+static void test_rep(const MemTableRepFactory *factory) {
+    InternalKeyComparator cmp(bytewise_comparator());
+    MemTableOptions options;
+    options.rep_factory = factory;
+
+    // test add and get
+    {
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        mem->add(1, ValType::VALUE, "foo", "v1");
+        mem->add(2, ValType::VALUE, "bar", "v2");
+        mem->add(3, ValType::VALUE, "foo", "v3");
+        mem->add(4, ValType::DELETION, "bar", "");
+
+        std::string value;
+        Status s;
+        assert(mem->get(LookupKey("foo", 10), &value, &s) && value == "v3");
+        assert(mem->get(LookupKey("foo", 2), &value, &s) && value == "v1");
+        assert(mem->get(LookupKey("bar", 3), &value, &s) && value == "v2");
+        assert(mem->get(LookupKey("bar", 4), &value, &s) && s.is_not_found());
+        assert(!mem->get(LookupKey("baz", 10), &value, &s));
+        assert(!mem->get(LookupKey("foo", 0), &value, &s));
+        mem->unref();
+    }
+    // test keys around the 8-byte inline prefix boundary
+    {
+        const char *keys[] = {"", "a", "ab", "ab\0", "abcdefg", "abcdefgh", "abcdefgh\0",
+                              "abcdefgha", "abcdefghb", "abcdefgi", "b", "\xff\xff"};
+        const size_t lens[] = {0, 1, 2, 3, 7, 8, 9, 9, 9, 8, 1, 2};
+        const int n = sizeof(lens) / sizeof(lens[0]);
+
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (int i = n - 1; i >= 0; i --) {
+            mem->add(i + 1, ValType::VALUE, Slice(keys[i], lens[i]), number_key(i));
+        }
+        std::string value;
+        Status s;
+        for (int i = 0; i < n; i ++) {
+            assert(mem->get(LookupKey(Slice(keys[i], lens[i]), 100), &value, &s));
+            assert(value == number_key(i));
+        }
+        assert(!mem->get(LookupKey(Slice("abcdefgh\0\0", 10), 100), &value, &s));
+        mem->unref();
+    }
+    // test concurrent add
+    {
+        const int N = 10000;
+        const int num_threads = 8;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+
+        std::vector<std::thread> writers;
+        for (int t = 0; t < num_threads; t ++) {
+            writers.emplace_back([mem, t]() {
+                for (int i = t; i < N; i += num_threads) {
+                    mem->add_concurrently(i + 1, ValType::VALUE, number_key(i), number_key(i));
+                }
+            });
+        }
+        for (auto &writer : writers) {
+            writer.join();
+        }
+
+        std::string value;
+        Status s;
+        for (int i = 0; i < N; i ++) {
+            assert(mem->get(LookupKey(number_key(i), N), &value, &s));
+            assert(value == number_key(i));
+        }
+        mem->unref();
+    }
+    // test iterator
+    {
+        const int N = 1000;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (int i = N - 1; i >= 0; i --) {
+            mem->add(i + 1, ValType::VALUE, number_key(i * 2), number_key(i));
+        }
+
+        Iterator *iter = mem->new_iterator();
+        ParsedInternalKey ikey;
+        iter->seek_to_first();
+        for (int i = 0; i < N; i ++) {
+            assert(iter->valid());
+            assert(parse_internal_key(iter->key(), &ikey) && ikey.user_key.to_string() == number_key(i * 2));
+            assert(iter->value().to_string() == number_key(i));
+            iter->next();
+        }
+        assert(!iter->valid());
+
+        iter->seek_to_last();
+        for (int i = N - 1; i >= 0; i --) {
+            assert(iter->valid());
+            assert(parse_internal_key(iter->key(), &ikey) && ikey.user_key.to_string() == number_key(i * 2));
+            iter->prev();
+        }
+        assert(!iter->valid());
+
+        std::string target;
+        append_internal_key(&target, ParsedInternalKey(number_key(N - 1), MAX_SEQ_NUM, ValType::VALUE));
+        iter->seek(target);
+        assert(iter->valid() && iter->value().to_string() == number_key(N / 2));
+        delete iter;
+        mem->unref();
+    }
+    // test multi_get matches get for unsorted keys with versions, deletions, duplicates and misses
+    {
+        const int N = 1000;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (int i = 0; i < N; i ++) {
+            mem->add(i + 1, ValType::VALUE, number_key(i * 2), number_key(i));
+            if (i % 3 == 0) mem->add(N + i + 1, ValType::VALUE, number_key(i * 2), "new");
+            if (i % 5 == 0) mem->add(2 * N + i + 1, ValType::DELETION, number_key(i * 2), "");
+        }
+        Random rnd(17);
+        for (SeqNum seq : {SeqNum(N / 2), SeqNum(3 * N / 2), SeqNum(3 * N)}) {
+            const size_t n = 200;
+            std::vector<std::string> key_data(n);
+            std::vector<Slice> keys(n);
+            for (size_t i = 0; i < n; i ++) {
+                key_data[i] = i % 10 == 0 && i > 0 ? key_data[i - 1] : number_key(rnd.uniform(2 * N + 1));
+                keys[i] = key_data[i];
+            }
+            std::vector<std::string> values(n);
+            std::vector<Status> statuses(n);
+            std::unique_ptr<bool[]> found(new bool[n]);
+            mem->multi_get(n, keys.data(), seq, values.data(), statuses.data(), found.get());
+            for (size_t i = 0; i < n; i ++) {
+                std::string value;
+                Status s;
+                bool expected = mem->get(LookupKey(keys[i], seq), &value, &s);
+                assert(found[i] == expected);
+                if (expected) {
+                    assert(statuses[i].is_not_found() == s.is_not_found());
+                    assert(s.is_not_found() || values[i] == value);
+                }
+            }
+        }
+        mem->unref();
+    }
+    // test reads after freeze() match those before, while a reader runs through the switch
+    {
+        const int N = 1000;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (int i = 0; i < N; i ++) {
+            mem->add(i + 1, ValType::VALUE, number_key(i * 2), number_key(i));
+            if (i % 4 == 0) mem->add(N + i + 1, ValType::DELETION, number_key(i * 2), "");
+        }
+        Iterator *old_iter = mem->new_iterator();
+        std::atomic<bool> stop(false);
+        std::thread reader([mem, &stop]() {
+            std::string value;
+            Status s;
+            while (!stop.load()) {
+                for (int i = 0; i < N; i += 7) {
+                    assert(mem->get(LookupKey(number_key(i * 2), 2 * N), &value, &s));
+                    assert(i % 4 == 0 ? s.is_not_found() : value == number_key(i));
+                }
+            }
+        });
+        mem->freeze();
+        mem->freeze();
+        stop.store(true);
+        reader.join();
+        assert(mem->is_frozen());
+
+        std::string value;
+        Status s;
+        for (int i = 0; i < 2 * N; i ++) {
+            bool found = mem->get(LookupKey(number_key(i), 2 * N), &value, &s);
+            assert(found == (i % 2 == 0));
+            if (found) assert(i % 8 == 0 ? s.is_not_found() : value == number_key(i / 2));
+            assert(mem->get(LookupKey(number_key(i), N), &value, &s) == found);
+        }
+        std::vector<Slice> keys;
+        std::vector<std::string> key_data;
+        for (int i = 2 * N - 1; i >= 0; i -= 3) key_data.push_back(number_key(i));
+        for (const std::string &key : key_data) keys.push_back(key);
+        std::vector<std::string> values(keys.size());
+        std::vector<Status> statuses(keys.size());
+        std::unique_ptr<bool[]> found(new bool[keys.size()]);
+        mem->multi_get(keys.size(), keys.data(), N, values.data(), statuses.data(), found.get());
+        for (size_t i = 0; i < keys.size(); i ++) {
+            assert(found[i] == (mem->get(LookupKey(keys[i], N), &value, &s)));
+            if (found[i]) assert(values[i] == value);
+        }
+
+        Iterator *iter = mem->new_iterator();
+        iter->seek_to_first();
+        for (old_iter->seek_to_first(); old_iter->valid(); old_iter->next(), iter->next()) {
+            assert(iter->valid() && iter->key().to_string() == old_iter->key().to_string());
+        }
+        assert(!iter->valid());
+        iter->seek_to_last();
+        old_iter->seek_to_last();
+        for (; old_iter->valid(); old_iter->prev(), iter->prev()) {
+            assert(iter->valid() && iter->key().to_string() == old_iter->key().to_string());
+        }
+        assert(!iter->valid());
+        std::string target;
+        append_internal_key(&target, ParsedInternalKey(number_key(N - 1), MAX_SEQ_NUM, ValType::SEEK));
+        iter->seek(target);
+        ParsedInternalKey ikey;
+        assert(iter->valid() && parse_internal_key(iter->key(), &ikey) && ikey.user_key.to_string() == number_key(N));
+        delete iter;
+        delete old_iter;
+        mem->unref();
+    }
+    // test order of long shared-prefix keys with 0x00 and 0xff bytes and many versions,
+    // plus a level with a child for every byte
+    {
+        Random rnd(301);
+        const char alphabet[] = {'\0', '\1', 'a', 'b', '/', '\xff'};
+        std::set<std::pair<std::string, SeqNum>> expected;
+        for (int b = 0; b < 256; b ++) {
+            expected.insert({std::string("tenant/bucket/") + static_cast<char>(b), 1});
+        }
+        for (SeqNum seq = 2; seq < 3000; seq ++) {
+            std::string key = "tenant/bucket/";
+            int len = rnd.uniform(6);
+            for (int i = 0; i < len; i ++) {
+                key.push_back(alphabet[rnd.uniform(sizeof(alphabet))]);
+            }
+            expected.insert({key, seq});
+        }
+
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (auto &e : expected) {
+            mem->add(e.second, ValType::VALUE, e.first, std::to_string(e.second));
+        }
+
+        // expected order: user key ascending, then sequence descending
+        std::vector<std::pair<std::string, SeqNum>> order(expected.begin(), expected.end());
+        std::stable_sort(order.begin(), order.end(), [](const auto &a, const auto &b) {
+            return a.first != b.first ? a.first < b.first : a.second > b.second;
+        });
+        Iterator *iter = mem->new_iterator();
+        ParsedInternalKey ikey;
+        iter->seek_to_first();
+        for (auto &e : order) {
+            assert(iter->valid());
+            assert(parse_internal_key(iter->key(), &ikey));
+            assert(ikey.user_key.to_string() == e.first && ikey.seq == e.second);
+            iter->next();
+        }
+        assert(!iter->valid());
+        iter->seek_to_last();
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            assert(iter->valid() && iter->value().to_string() == std::to_string(it->second));
+            iter->prev();
+        }
+        assert(!iter->valid());
+        delete iter;
+
+        // newest version of each key is visible at a large sequence number
+        std::string value;
+        Status s;
+        for (size_t i = 0; i < order.size(); i ++) {
+            if (i == 0 || order[i].first != order[i - 1].first) {
+                assert(mem->get(LookupKey(order[i].first, 10000), &value, &s));
+                assert(value == std::to_string(order[i].second));
+            }
+        }
+        // each version is visible at its own sequence number, and none before the oldest
+        for (size_t i = 0; i < order.size(); i ++) {
+            assert(mem->get(LookupKey(order[i].first, order[i].second), &value, &s));
+            assert(value == std::to_string(order[i].second));
+            if (i + 1 == order.size() || order[i].first != order[i + 1].first) {
+                assert(!mem->get(LookupKey(order[i].first, order[i].second - 1), &value, &s));
+            }
+        }
+        assert(!mem->get(LookupKey("tenant/bucket", 10000), &value, &s));
+        // keys too long to look up without allocating
+        const std::string long_key = std::string(300, 'x') + std::string(1, '\0');
+        for (SeqNum seq = 5000; seq < 5010; seq ++) {
+            mem->add(seq, ValType::VALUE, long_key, std::to_string(seq));
+        }
+        assert(mem->get(LookupKey(long_key, 5005), &value, &s) && value == "5005");
+        assert(!mem->get(LookupKey(long_key, 4999), &value, &s));
+        assert(!mem->get(LookupKey(long_key.substr(0, 300), 10000), &value, &s));
+        mem->unref();
+    }
+}
+
+// skiplist rep that counts searches, to tell lookups the bloom filter let through
+class CountingRep: public MemTableRep {
+public:
+    explicit CountingRep(MemTableRep *rep): rep(rep), gets(0) {}
+    void insert(const char *entry) override { rep->insert(entry); }
+    void insert_concurrently(const char *entry) override { rep->insert_concurrently(entry); }
+    void get(const char *key, void *arg, bool (*callback)(void *arg, const char *entry)) override {
+        gets ++;
+        rep->get(key, arg, callback);
+    }
+    Iterator *new_iterator() override { return rep->new_iterator(); }
+
+    const std::unique_ptr<MemTableRep> rep;
+    int gets;
+};
+
+class CountingRepFactory: public MemTableRepFactory {
+public:
+    CountingRepFactory(): skiplist(new_skiplist_rep_factory()), last(nullptr) {}
+    const char *name() const override { return "CountingRep"; }
+    MemTableRep *create(const MemTableKeyComparator &cmp, Arena *arena) const override {
+        last = new CountingRep(skiplist->create(cmp, arena));
+        return last;
+    }
+    const std::unique_ptr<MemTableRepFactory> skiplist;
+    mutable CountingRep *last;
+};
+
+// test bloom filter in whole key and prefix mode. keys are "p<3 digits>/<suffix>", so prefixes
+// of length 4 tell keys apart by their first part only
+static void test_bloom(size_t prefix_length) {
+    InternalKeyComparator cmp(bytewise_comparator());
+    CountingRepFactory factory;
+    MemTableOptions options;
+    options.rep_factory = &factory;
+    options.bloom_bits = 10 * 1000;
+    options.bloom_prefix_length = prefix_length;
+    MemTable *mem = new MemTable(cmp, options);
+    mem->ref();
+    CountingRep *rep = factory.last;
+
+    auto make_key = [](int prefix, int suffix) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "p%03d/%d", prefix, suffix);
+        return std::string(buf);
+    };
+    // 10 keys for each even prefix below 200
+    SeqNum seq = 0;
+    for (int p = 0; p < 200; p += 2) {
+        for (int s = 0; s < 10; s ++) {
+            seq ++;
+            mem->add(seq, (s == 0) ? ValType::DELETION : ValType::VALUE, make_key(p, s), make_key(p, s));
+        }
+    }
+    std::string value;
+    Status s;
+    // no false negatives
+    for (int p = 0; p < 200; p += 2) {
+        for (int i = 0; i < 10; i ++) {
+            s = Status::OK();
+            assert(mem->get(LookupKey(make_key(p, i), seq), &value, &s));
+            assert(i == 0 ? s.is_not_found() : (s.ok() && value == make_key(p, i)));
+        }
+    }
+    // absent keys under added prefixes pass a prefix filter, and are mostly rejected by a whole
+    // key one
+    int gets = rep->gets;
+    for (int p = 0; p < 200; p += 2) {
+        assert(!mem->get(LookupKey(make_key(p, 10), seq), &value, &s));
+    }
+    if (prefix_length == 4) {
+        assert(rep->gets - gets == 100);
+    } else {
+        assert(rep->gets - gets < 10);
+    }
+    // absent prefixes are mostly rejected in either mode
+    gets = rep->gets;
+    for (int p = 1; p < 1000; p += 2) {
+        assert(!mem->get(LookupKey(make_key(p, 1), seq), &value, &s));
+    }
+    assert(rep->gets - gets < 25);
+    assert(!mem->get(LookupKey("", seq), &value, &s));
+    mem->unref();
+}
+
+int main() {
+    MemTableRepFactory *factories[] = {
+        new_skiplist_rep_factory(),
+        new_hash_bucket_rep_factory(),
+        new_hash_bucket_rep_factory(1, 3),
+        new_vector_rep_factory(),
+        new_art_rep_factory(),
+    };
+    for (MemTableRepFactory *factory : factories) {
+        test_rep(factory);
+        delete factory;
+    }
+    // test an empty hash bucket memtable stays small, as it's charged to the write buffer manager
+    {
+        MemTableRepFactory *factory = new_hash_bucket_rep_factory();
+        InternalKeyComparator cmp(bytewise_comparator());
+        MemTableOptions options;
+        options.rep_factory = factory;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        assert(mem->approxi_mem_usage() < 64 * 1024);
+        mem->unref();
+        delete factory;
+    }
+    // test arena with growing, huge page backed blocks
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        MemTableOptions options;
+        options.arena_max_block_size = 4 * 1024 * 1024;
+        options.huge_page_size = 2 * 1024 * 1024;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (int i = 0; i < 10000; i ++) {
+            mem->add(i + 1, ValType::VALUE, number_key(i), number_key(i));
+        }
+        std::string value;
+        Status s;
+        for (int i = 0; i < 10000; i ++) {
+            assert(mem->get(LookupKey(number_key(i), 10000), &value, &s) && value == number_key(i));
+        }
+        assert(mem->approxi_mem_usage() >= options.huge_page_size);
+        ArenaStats stats = mem->get_arena_stats();
+        assert(stats.used_bytes > 0 && stats.allocated_bytes >= stats.used_bytes);
+        mem->unref();
+    }
+    // test memtables recycling arena blocks through a pool
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        ArenaBlockPool pool(1024 * 1024);
+        MemTableOptions options;
+        options.block_pool = &pool;
+        for (int round = 0; round < 3; round ++) {
+            MemTable *mem = new MemTable(cmp, options);
+            mem->ref();
+            for (int i = 0; i < 1000; i ++) {
+                mem->add(i + 1, ValType::VALUE, number_key(i), number_key(round));
+            }
+            std::string value;
+            Status s;
+            assert(mem->get(LookupKey(number_key(999), 1000), &value, &s) && value == number_key(round));
+            mem->unref();
+            assert(pool.get_retained_bytes() > 0);
+        }
+        // concurrent writes give blocks back to the pool and take them from it too
+        auto add_concurrently = [](MemTable *mem) {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; t ++) {
+                threads.emplace_back([mem, t]() {
+                    for (int i = 0; i < 250; i ++) {
+                        mem->add_concurrently(t * 250 + i + 1, ValType::VALUE, number_key(t * 250 + i), "v");
+                    }
+                });
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+        };
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        add_concurrently(mem);
+        mem->unref();
+        size_t retained = pool.get_retained_bytes();
+        mem = new MemTable(cmp, options);
+        mem->ref();
+        add_concurrently(mem);
+        assert(pool.get_retained_bytes() + 16 * 1024 <= retained);
+        std::string value;
+        Status s;
+        assert(mem->get(LookupKey(number_key(999), 1000), &value, &s) && value == "v");
+        mem->unref();
+        assert(pool.get_retained_bytes() == retained);
+    }
+    // test range deletions hide older entries from get() and iterators
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        MemTableOptions options;
+        options.bloom_bits = 10 * 1000;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        for (int i = 0; i < 100; i ++) {
+            mem->add(i + 1, ValType::VALUE, number_key(i), number_key(i));
+        }
+        mem->delete_range(200, number_key(10), number_key(20));
+        mem->delete_range(300, number_key(15), number_key(30));
+        mem->add(400, ValType::VALUE, number_key(12), "new");
+        mem->delete_range(500, number_key(1000), number_key(2000));
+
+        std::string value;
+        Status s;
+        for (int i = 0; i < 100; i ++) {
+            bool deleted = (i >= 10 && i < 30 && i != 12);
+            s = Status::OK();
+            assert(mem->get(LookupKey(number_key(i), 1000), &value, &s));
+            assert(deleted ? s.is_not_found() : s.ok());
+            // tombstones are invisible to older snapshots
+            s = Status::OK();
+            assert(mem->get(LookupKey(number_key(i), 250), &value, &s));
+            assert((i >= 10 && i < 20) ? s.is_not_found() : (s.ok() && value == number_key(i)));
+        }
+        assert(mem->get(LookupKey(number_key(12), 1000), &value, &s) && value == "new");
+        // keys never added but covered by a tombstone are reported deleted, filter or not
+        s = Status::OK();
+        assert(mem->get(LookupKey(number_key(1500), 1000), &value, &s) && s.is_not_found());
+        assert(!mem->get(LookupKey(number_key(1500), 400), &value, &s));
+
+        Iterator *iter = mem->new_iterator();
+        std::vector<std::string> keys;
+        ParsedInternalKey ikey;
+        for (iter->seek_to_first(); iter->valid(); iter->next()) {
+            assert(parse_internal_key(iter->key(), &ikey));
+            keys.push_back(ikey.user_key.to_string());
+        }
+        assert(keys.size() == 100 - 20 + 1);
+        assert(keys[10] == number_key(12) && keys[11] == number_key(30));
+        size_t n = 0;
+        for (iter->seek_to_last(); iter->valid(); iter->prev()) {
+            assert(parse_internal_key(iter->key(), &ikey));
+            assert(ikey.user_key.to_string() == keys[keys.size() - 1 - n]);
+            n ++;
+        }
+        assert(n == keys.size());
+        std::string target;
+        append_internal_key(&target, ParsedInternalKey(number_key(15), MAX_SEQ_NUM, ValType::SEEK));
+        iter->seek(target);
+        assert(iter->valid() && parse_internal_key(iter->key(), &ikey));
+        assert(ikey.user_key.to_string() == number_key(30));
+        delete iter;
+
+        // an iterator at an older snapshot only hides what that snapshot's tombstones cover
+        iter = mem->new_iterator(250);
+        n = 0;
+        for (iter->seek_to_first(); iter->valid(); iter->next()) {
+            n ++;
+        }
+        assert(n == 100 - 10 + 1);
+        delete iter;
+
+        iter = mem->new_range_del_iterator();
+        n = 0;
+        for (iter->seek_to_first(); iter->valid(); iter->next()) {
+            assert(parse_internal_key(iter->key(), &ikey) && ikey.type == ValType::RANGE_DELETION);
+            n ++;
+        }
+        assert(n == 3);
+        delete iter;
+        mem->unref();
+    }
+    // test readers see tombstones added while they read
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        MemTable *mem = new MemTable(cmp, MemTableOptions());
+        mem->ref();
+        const int N = 200;
+        for (int i = 0; i < N; i ++) {
+            mem->add(i + 1, ValType::VALUE, number_key(i), number_key(i));
+        }
+        std::atomic<int> deleted(0);    // keys below it are deleted
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; t ++) {
+            readers.emplace_back([&, t]() {
+                Random rnd(301 + t);
+                std::string value;
+                while (deleted.load() < N) {
+                    int bound = deleted.load();
+                    int i = rnd.uniform(N);
+                    Status s;
+                    assert(mem->get(LookupKey(number_key(i), 10 * N), &value, &s));
+                    assert(i >= bound || s.is_not_found());
+                }
+            });
+        }
+        for (int i = 0; i < N; i ++) {
+            mem->delete_range(N + i + 1, number_key(i), number_key(i + 1));
+            deleted.store(i + 1);
+        }
+        for (auto &reader : readers) {
+            reader.join();
+        }
+        mem->unref();
+    }
+    // test merge operands are collapsed by get() and iterators
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        MemTableOptions options;
+        const MergeOperator *add = new_uint64_add_merge_operator();
+        options.merge_operator = add;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        auto fixed = [](uint64_t v) { std::string s; append_fixed_64(&s, v); return s; };
+        mem->add(1, ValType::VALUE, "counter", fixed(10));
+        for (int i = 0; i < 5; i ++) {
+            mem->merge(2 + i, "counter", fixed(1));     // seq 2 ~ 6
+        }
+        mem->merge(7, "fresh", fixed(3));
+        mem->merge(8, "fresh", fixed(4));
+        mem->add(9, ValType::DELETION, "gone", "");
+        mem->merge(10, "gone", fixed(5));
+        mem->add(11, ValType::VALUE, "ranged", fixed(100));
+        mem->delete_range(12, "ranged", "rangef");
+        mem->merge(13, "ranged", fixed(6));
+
+        std::string value;
+        Status s;
+        assert(mem->get(LookupKey("counter", 100), &value, &s) && s.ok());
+        assert(decode_fixed_64(value.data()) == 15);
+        assert(mem->get(LookupKey("counter", 4), &value, &s) && decode_fixed_64(value.data()) == 13);
+        assert(mem->get(LookupKey("gone", 100), &value, &s) && decode_fixed_64(value.data()) == 5);
+        assert(mem->get(LookupKey("ranged", 100), &value, &s) && decode_fixed_64(value.data()) == 6);
+        assert(mem->get(LookupKey("ranged", 12), &value, &s) && s.is_not_found());
+        // without a base the memtable is the only source, unless a merge context is passed
+        assert(mem->get(LookupKey("fresh", 100), &value, &s) && decode_fixed_64(value.data()) == 7);
+        MergeContext merge_context;
+        merge_context.operands.push_back(fixed(20));    // from a newer memtable
+        assert(!mem->get(LookupKey("fresh", 100), &value, &s, &merge_context));
+        assert(merge_context.operands.size() == 3 && decode_fixed_64(merge_context.operands[2].data()) == 3);
+        merge_context.operands.resize(1);
+        assert(mem->get(LookupKey("counter", 100), &value, &s, &merge_context));
+        assert(decode_fixed_64(value.data()) == 35 && merge_context.operands.empty());
+
+        // collapsed entries expected from the iterator, newest entry of a key first
+        struct { const char *user_key; SeqNum seq; ValType type; uint64_t value; } expected[] = {
+            {"counter", 6, ValType::VALUE, 15}, {"counter", 1, ValType::VALUE, 10},
+            {"fresh", 8, ValType::MERGE, 7},
+            {"gone", 10, ValType::VALUE, 5}, {"gone", 9, ValType::DELETION, 0},
+            {"ranged", 13, ValType::VALUE, 6},
+        };
+        const size_t n = sizeof(expected) / sizeof(expected[0]);
+        Iterator *iter = mem->new_iterator();
+        ParsedInternalKey ikey;
+        size_t i = 0;
+        for (iter->seek_to_first(); iter->valid(); iter->next(), i ++) {
+            assert(i < n && parse_internal_key(iter->key(), &ikey));
+            assert(ikey.user_key.to_string() == expected[i].user_key && ikey.seq == expected[i].seq && ikey.type == expected[i].type);
+            assert(ikey.type == ValType::DELETION || decode_fixed_64(iter->value().data()) == expected[i].value);
+        }
+        assert(i == n);
+        for (iter->seek_to_last(); iter->valid(); iter->prev()) {
+            assert(i > 0 && parse_internal_key(iter->key(), &ikey));
+            i --;
+            assert(ikey.user_key.to_string() == expected[i].user_key && ikey.seq == expected[i].seq);
+        }
+        assert(i == 0);
+        // change direction in the middle of a group
+        std::string target;
+        append_internal_key(&target, ParsedInternalKey("gone", MAX_SEQ_NUM, ValType::SEEK));
+        iter->seek(target);
+        iter->next();
+        assert(iter->valid() && parse_internal_key(iter->key(), &ikey) && ikey.seq == 9);
+        iter->prev();
+        iter->prev();
+        assert(iter->valid() && parse_internal_key(iter->key(), &ikey) && ikey.user_key.to_string() == "fresh");
+        iter->next();
+        iter->next();
+        iter->next();
+        assert(iter->valid() && parse_internal_key(iter->key(), &ikey) && ikey.user_key.to_string() == "ranged");
+        assert(iter->status().ok());
+        delete iter;
+
+        // an iterator at an older snapshot leaves newer entries as they are
+        iter = mem->new_iterator(3);
+        iter->seek_to_first();
+        assert(parse_internal_key(iter->key(), &ikey) && ikey.seq == 6 && ikey.type == ValType::MERGE);
+        for (SeqNum seq = 5; seq >= 4; seq --) {
+            iter->next();
+            assert(parse_internal_key(iter->key(), &ikey) && ikey.seq == seq && ikey.type == ValType::MERGE);
+        }
+        iter->next();
+        assert(parse_internal_key(iter->key(), &ikey) && ikey.seq == 3 && ikey.type == ValType::VALUE);
+        assert(decode_fixed_64(iter->value().data()) == 12);
+        delete iter;
+        mem->unref();
+
+        // merge operands can't be read without a merge operator
+        mem = new MemTable(cmp);
+        mem->ref();
+        mem->merge(1, "key", "operand");
+        assert(mem->get(LookupKey("key", 100), &value, &s) && s.is_not_supported_error());
+        mem->unref();
+
+        // string append, partially merged by the iterator
+        const MergeOperator *append = new_string_append_merge_operator(',');
+        options.merge_operator = append;
+        mem = new MemTable(cmp, options);
+        mem->ref();
+        mem->merge(1, "list", "a");
+        mem->merge(2, "list", "b");
+        mem->merge(3, "list", "c");
+        assert(mem->get(LookupKey("list", 100), &value, &s) && value == "a,b,c");
+        iter = mem->new_iterator();
+        iter->seek_to_first();
+        assert(iter->valid() && iter->value().to_string() == "a,b,c");
+        iter->next();
+        assert(!iter->valid());
+        delete iter;
+        mem->unref();
+        // same with a radix tree rep, whose get() walks the operands itself
+        MemTableRepFactory *art = new_art_rep_factory();
+        options.rep_factory = art;
+        mem = new MemTable(cmp, options);
+        mem->ref();
+        mem->add(1, ValType::VALUE, "list", "x");
+        mem->merge(2, "list", "a");
+        mem->merge(3, "list", "b");
+        mem->merge(4, "list", "c");
+        mem->add(5, ValType::VALUE, "lists", "y");
+        assert(mem->get(LookupKey("list", 100), &value, &s) && value == "x,a,b,c");
+        assert(mem->get(LookupKey("list", 3), &value, &s) && value == "x,a,b");
+        mem->unref();
+        delete art;
+        delete append;
+        delete add;
+    }
+    // test in-place updates overwrite values that fit instead of adding entries
+    {
+        InternalKeyComparator cmp(bytewise_comparator());
+        MemTableOptions options;
+        options.inplace_update_support = true;
+        MemTable *mem = new MemTable(cmp, options);
+        mem->ref();
+        mem->add(1, ValType::VALUE, "flag", "on ");
+        size_t used = mem->get_arena_stats().used_bytes;
+        for (int i = 2; i < 1000; i ++) {
+            mem->add(i, ValType::VALUE, "flag", i % 2 == 0 ? "off" : "on ");
+        }
+        assert(mem->get_arena_stats().used_bytes == used);
+        std::string value;
+        Status s;
+        assert(mem->get(LookupKey("flag", 1000), &value, &s) && value == "on ");
+        // without in-place updates, each write adds an entry
+        {
+            MemTableOptions plain_options;
+            MemTable *plain = new MemTable(cmp, plain_options);
+            plain->ref();
+            for (int i = 1; i < 1000; i ++) {
+                plain->add(i, ValType::VALUE, "flag", i % 2 == 0 ? "off" : "on ");
+            }
+            assert(plain->get_arena_stats().used_bytes > used + 998 * 17);    // 17 bytes an entry, besides the rep
+            plain->unref();
+        }
+        // a value of another size or a deletion adds an entry. once the key has more than
+        // one entry, values are added too, so snapshots between them stay consistent
+        mem->add(1000, ValType::VALUE, "flag", "unknown");
+        assert(mem->get_arena_stats().used_bytes > used);
+        mem->add(1001, ValType::DELETION, "flag", "");
+        mem->add(1002, ValType::VALUE, "flag", "on");
+        mem->add(1003, ValType::VALUE, "flag", "no");
+        assert(mem->get(LookupKey("flag", 2000), &value, &s) && value == "no");
+        assert(mem->get(LookupKey("flag", 1002), &value, &s) && value == "on");
+        mem->add(1004, ValType::VALUE, "other", "abc");
+        mem->add(1005, ValType::VALUE, "other", "ab");
+
+        std::vector<std::pair<SeqNum, std::string>> expected = {
+            {1003, "no"}, {1002, "on"}, {1001, ""}, {1000, "unknown"}, {999, "on "}, {1005, "ab"}, {1004, "abc"}};
+        Iterator *iter = mem->new_iterator();
+        ParsedInternalKey ikey;
+        size_t i = 0;
+        for (iter->seek_to_first(); iter->valid(); iter->next(), i ++) {
+            assert(i < expected.size() && parse_internal_key(iter->key(), &ikey));
+            assert(ikey.seq == expected[i].first && iter->value().to_string() == expected[i].second);
+        }
+        assert(i == expected.size());
+        delete iter;
+
+        // concurrent writers to the same keys keep each key's entries in order
+        std::vector<std::thread> threads;
+        std::atomic<SeqNum> next_seq(2000);
+        for (int t = 0; t < 4; t ++) {
+            threads.emplace_back([&]() {
+                for (int j = 0; j < 1000; j ++) {
+                    SeqNum seq = next_seq.fetch_add(1);
+                    mem->add_concurrently(seq, seq % 7 == 0 ? ValType::DELETION : ValType::VALUE,
+                                          number_key(seq % 10), number_key(seq));
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        iter = mem->new_iterator();
+        std::string last_key;
+        SeqNum last_seq = 0;
+        for (iter->seek_to_first(); iter->valid(); iter->next()) {
+            assert(parse_internal_key(iter->key(), &ikey));
+            if (ikey.user_key.to_string() == last_key) assert(ikey.seq < last_seq);
+            last_key = ikey.user_key.to_string();
+            last_seq = ikey.seq;
+        }
+        delete iter;
+        for (int k = 0; k < 10; k ++) {
+            SeqNum seq = 6000 - 1;
+            while (seq % 10 != static_cast<SeqNum>(k)) seq --;
+            assert(mem->get(LookupKey(number_key(k), 10000), &value, &s));
+            assert(seq % 7 == 0 ? s.is_not_found() : value == number_key(seq));
+        }
+        mem->unref();
+
+        // iterators racing with updates in place see whole entries, whose value matches seq
+        mem = new MemTable(cmp, options);
+        mem->ref();
+        auto value_of = [](SeqNum seq) { return std::string(4096, seq % 2 == 0 ? 'x' : 'y'); };
+        mem->add(1, ValType::VALUE, "a", "1");
+        mem->add(2, ValType::VALUE, "b", value_of(2));
+        mem->add(3, ValType::VALUE, "c", "3");
+        std::atomic<bool> done(false);
+        std::thread updater([&]() {
+            for (SeqNum seq = 4; seq < 20000; seq ++) mem->add(seq, ValType::VALUE, "b", value_of(seq));
+            done = true;
+        });
+        threads.clear();
+        for (int t = 0; t < 2; t ++) {
+            threads.emplace_back([&]() {
+                Iterator *iter = mem->new_iterator();
+                ParsedInternalKey ikey;
+                while (!done) {
+                    iter->seek(LookupKey("b", MAX_SEQ_NUM).internal_key());
+                    assert(iter->valid() && parse_internal_key(iter->key(), &ikey));
+                    assert(ikey.user_key.to_string() == "b" && iter->value().to_string() == value_of(ikey.seq));
+                    iter->next();
+                    iter->prev();
+                    assert(iter->valid() && parse_internal_key(iter->key(), &ikey));
+                    assert(ikey.user_key.to_string() == "b" && iter->value().to_string() == value_of(ikey.seq));
+                }
+                delete iter;
+            });
+        }
+        updater.join();
+        for (auto &thread : threads) thread.join();
+        mem->unref();
+
+        // reps with their own copy of keys don't update in place
+        MemTableRepFactory *art = new_art_rep_factory();
+        options.rep_factory = art;
+        mem = new MemTable(cmp, options);
+        mem->ref();
+        mem->add(1, ValType::VALUE, "flag", "on ");
+        used = mem->get_arena_stats().used_bytes;
+        mem->add(2, ValType::VALUE, "flag", "off");
+        assert(mem->get_arena_stats().used_bytes > used);
+        assert(mem->get(LookupKey("flag", 1), &value, &s) && value == "on ");
+        assert(mem->get(LookupKey("flag", 2), &value, &s) && value == "off");
+        mem->unref();
+        delete art;
+    }
+    test_bloom(0);
+    test_bloom(4);
+    test_bloom(100);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <cassert>
+#include <vector>
+#include "db/range_tombstone.h"
+using namespace stackdb;
+
+int main() {
+    const Comparator *cmp = bytewise_comparator();
+    // test no tombstones
+    {
+        FragmentedRangeTombstones tombstones({}, cmp);
+        assert(tombstones.empty());
+        assert(tombstones.max_covering_seq("a") == 0);
+    }
+    // test overlapping tombstones are cut into fragments
+    {
+        //  a   b   c   d   e   f
+        //  [---------)             @ 10
+        //      [-------)           @ 20
+        //          [-------)       @ 5
+        //                  [---)   @ 30
+        std::vector<RangeTombstone> list = {
+            {"a", "c", 10}, {"b", "d", 20}, {"c", "e", 5}, {"e", "f", 30}};
+        FragmentedRangeTombstones tombstones(list, cmp);
+        assert(tombstones.num_fragments() == 5);
+
+        assert(tombstones.max_covering_seq("") == 0);
+        assert(tombstones.max_covering_seq("a") == 10);
+        assert(tombstones.max_covering_seq("az") == 10);
+        assert(tombstones.max_covering_seq("b") == 20);
+        assert(tombstones.max_covering_seq("c") == 20);
+        assert(tombstones.max_covering_seq("d") == 5);
+        assert(tombstones.max_covering_seq("e") == 30);
+        assert(tombstones.max_covering_seq("f") == 0);
+        assert(tombstones.max_covering_seq("z") == 0);
+
+        // only tombstones visible at read seq count
+        assert(tombstones.max_covering_seq("b", 19) == 10);
+        assert(tombstones.max_covering_seq("b", 9) == 0);
+        assert(tombstones.max_covering_seq("c", 10) == 5);
+        assert(tombstones.max_covering_seq("e", 29) == 0);
+    }
+    // test gaps, empty ranges and identical ranges
+    {
+        std::vector<RangeTombstone> list = {
+            {"a", "b", 1}, {"x", "x", 2}, {"c", "d", 3}, {"c", "d", 4}, {"q", "p", 5}};
+        FragmentedRangeTombstones tombstones(list, cmp);
+        assert(tombstones.num_fragments() == 2);
+        assert(tombstones.max_covering_seq("a") == 1);
+        assert(tombstones.max_covering_seq("b") == 0);
+        assert(tombstones.max_covering_seq("c") == 4);
+        assert(tombstones.max_covering_seq("c", 3) == 3);
+        assert(tombstones.max_covering_seq("x") == 0);
+        assert(tombstones.max_covering_seq("p") == 0);
+    }
+    return 0;
+}
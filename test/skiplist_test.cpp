@@ -1,5 +1,7 @@
 #include <iostream>
 #include <set>
+#include <vector>
+#include <thread>
 #include "db/skiplist.h"
 #include "util/arena.h"
 #include "util/random.h"
@@ -19,6 +21,13 @@ struct Comparator {
     }
 };
 
+// same order, but opts in to the inline key prefix. the prefix is coarse
+// on purpose, so that equal prefixes fall back to a full comparison
+struct PrefixComparator: public Comparator {
+    bool key_prefix_enabled() const { return true; }
+    uint64_t key_prefix(const Key &key) const { return key >> 4; }
+};
+
 int main() {
     // test empty
     {   
@@ -80,6 +89,18 @@ int main() {
             assert(*(keys.rbegin()) == iter.key());
         }
 
+        // finger seek test, ascending and then in random order
+        {
+            SkipList<Key, Comparator>::Iterator iter(&list);
+            SkipList<Key, Comparator>::Splice finger;
+            for (int i = 0; i < R + 10; i ++) {
+                Key target = i < R ? i : rnd.next() % R;
+                iter.seek(target, &finger);
+                auto model_iter = keys.lower_bound(target);
+                assert(model_iter == keys.end() ? !iter.valid() : iter.valid() && iter.key() == *model_iter);
+            }
+        }
+
         // forward iteration test
         {
             for (int i = 0; i < R; i ++) {
@@ -116,9 +137,201 @@ int main() {
         }
     }
 
-    // NEED: add concurrent test for skiplist
+    // inline key prefix test
     {
-        // ...
+        const int N = 2000;
+        const int R = 5000;
+        Random rnd(1001);
+        std::set<Key> keys;
+
+        Arena arena;
+        PrefixComparator cmp;
+        SkipList<Key, PrefixComparator> list(cmp, &arena);
+        SkipList<Key, PrefixComparator>::Splice hint;
+
+        for (int i = 0; i < N; i ++) {
+            Key key = rnd.next() % R;
+            if (keys.insert(key).second) {
+                if (rnd.one_in(2)) {
+                    list.insert(key);
+                } else {
+                    list.insert_with_hint(key, &hint);
+                }
+            }
+        }
+        for (int i = 0; i < R; i ++) {
+            assert(list.contains(i) == (keys.count(i) == 1));
+        }
+
+        SkipList<Key, PrefixComparator>::Iterator iter(&list);
+        iter.seek_to_last();
+        for (auto model_iter = keys.rbegin(); model_iter != keys.rend(); ++ model_iter) {
+            assert(iter.valid());
+            assert(iter.key() == *model_iter);
+            iter.prev();
+        }
+        assert(!iter.valid());
+    }
+    // backward link test. reverse iteration over all insert paths, with and without prefixes
+    {
+        const int N = 3000;
+        Random rnd(1002);
+        std::set<Key> keys;
+
+        Arena arena;
+        Comparator cmp;
+        PrefixComparator prefix_cmp;
+        SkipList<Key, Comparator> list(cmp, &arena, true);
+        SkipList<Key, PrefixComparator> prefix_list(prefix_cmp, &arena, true);
+        SkipList<Key, Comparator>::Splice hint;
+        SkipList<Key, PrefixComparator>::Splice prefix_hint;
+
+        for (int i = 0; i < N; i ++) {
+            Key key = rnd.next() % (N * 10);
+            if (!keys.insert(key).second) continue;
+            switch (rnd.uniform(3)) {
+            case 0:
+                list.insert(key);
+                prefix_list.insert(key);
+                break;
+            case 1:
+                list.insert_with_hint(key, &hint);
+                prefix_list.insert_with_hint(key, &prefix_hint);
+                break;
+            default:
+                list.insert_concurrently(key);
+                prefix_list.insert_concurrently(key);
+                break;
+            }
+        }
+
+        SkipList<Key, Comparator>::Iterator iter(&list);
+        SkipList<Key, PrefixComparator>::Iterator prefix_iter(&prefix_list);
+        iter.seek_to_last();
+        prefix_iter.seek_to_last();
+        for (auto model_iter = keys.rbegin(); model_iter != keys.rend(); ++ model_iter) {
+            assert(iter.valid() && prefix_iter.valid());
+            assert(iter.key() == *model_iter && prefix_iter.key() == *model_iter);
+            iter.prev();
+            prefix_iter.prev();
+        }
+        assert(!iter.valid() && !prefix_iter.valid());
+
+        // step back after a seek into the middle
+        iter.seek(N * 5);
+        auto model_iter = keys.lower_bound(N * 5);
+        assert(iter.valid() && iter.key() == *model_iter);
+        iter.prev();
+        assert(iter.valid() && iter.key() == *(--model_iter));
+    }
+    // insert with hint test. ascending, descending and random streams, mixed with plain inserts
+    {
+        const int N = 3000;
+        Random rnd(301);
+        std::set<Key> keys;
+
+        Arena arena;
+        Comparator cmp;
+        SkipList<Key, Comparator> list(cmp, &arena);
+        SkipList<Key, Comparator>::Splice hint;
+
+        for (int i = 0; i < N; i ++) {              // ascending
+            keys.insert(i * 10);
+            list.insert_with_hint(i * 10, &hint);
+        }
+        for (int i = N; i > 0; i --) {              // descending
+            keys.insert(i * 10 - 5);
+            list.insert_with_hint(i * 10 - 5, &hint);
+        }
+        for (int i = 0; i < N; i ++) {              // random, sometimes through insert()
+            Key key = rnd.next() % (N * 10);
+            if (keys.insert(key).second) {
+                if (rnd.one_in(3)) {
+                    list.insert(key);
+                } else {
+                    list.insert_with_hint(key, &hint);
+                }
+            }
+        }
+
+        SkipList<Key, Comparator>::Iterator iter(&list);
+        iter.seek_to_first();
+        for (Key key : keys) {
+            assert(iter.valid());
+            assert(iter.key() == key);
+            iter.next();
+        }
+        assert(!iter.valid());
+    }
+    // insert sorted test
+    {
+        std::vector<Key> batch;
+        for (int i = 0; i < 1000; i ++) {
+            batch.push_back(i * 3);
+        }
+
+        Arena arena;
+        Comparator cmp;
+        SkipList<Key, Comparator> list(cmp, &arena);
+        list.insert(1);
+        list.insert_sorted(batch.begin(), batch.end());
+
+        for (int i = 0; i < 3000; i ++) {
+            assert(list.contains(i) == (i % 3 == 0 || i == 1));
+        }
+    }
+    // concurrent insert test. each writer inserts its own residue class of keys,
+    // while the main thread checks that any snapshot it iterates is sorted
+    {
+        const int N = 20000;
+        for (int num_threads : {1, 2, 4, 8, 16}) {
+            Arena arena;
+            Comparator cmp;
+            SkipList<Key, Comparator> list(cmp, &arena, true);
+
+            std::atomic<int> done(0);
+            std::vector<std::thread> writers;
+            for (int t = 0; t < num_threads; t ++) {
+                writers.emplace_back([&list, &done, t, num_threads]() {
+                    for (int i = t; i < N; i += num_threads) {
+                        list.insert_concurrently(static_cast<Key>(i) * 7919 % N);
+                    }
+                    done.fetch_add(1);
+                });
+            }
+            while (done.load() < num_threads) {
+                SkipList<Key, Comparator>::Iterator iter(&list);
+                iter.seek_to_first();
+                if (iter.valid()) {
+                    Key last = iter.key();
+                    for (iter.next(); iter.valid(); iter.next()) {
+                        assert(last < iter.key());
+                        last = iter.key();
+                    }
+                }
+            }
+            for (auto &writer : writers) {
+                writer.join();
+            }
+
+            // 7919 is prime, so keys cover [0, N - 1] exactly once
+            SkipList<Key, Comparator>::Iterator iter(&list);
+            iter.seek_to_first();
+            for (int i = 0; i < N; i ++) {
+                assert(iter.valid());
+                assert(iter.key() == static_cast<Key>(i));
+                iter.next();
+            }
+            assert(!iter.valid());
+            // back links raced with the inserts, they must still lead to the right nodes
+            iter.seek_to_last();
+            for (int i = N - 1; i >= 0; i --) {
+                assert(iter.valid());
+                assert(iter.key() == static_cast<Key>(i));
+                iter.prev();
+            }
+            assert(!iter.valid());
+        }
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "db/memtable.h"
+#include "db/write_buffer_manager.h"
+#include "stackdb/comparator.h"
+using namespace stackdb;
+
+static std::string number_key(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+// records the memtables handed back to flush, as an owner would schedule their flushes
+static void record_flush(void *arg, MemTable *mem) {
+    reinterpret_cast<std::vector<MemTable *> *>(arg)->push_back(mem);
+}
+
+// drops the owner's ref on the memtable handed back, as a flush done on another thread
+// would, and checks the memtable outlives the call
+struct DropOwnerRef {
+    WriteBufferManager *manager;
+    int calls;
+};
+static void drop_owner_ref(void *arg, MemTable *mem) {
+    DropOwnerRef *drop = reinterpret_cast<DropOwnerRef *>(arg);
+    mem->unref();
+    assert(drop->manager->get_memory_being_freed() > 0);    // not destroyed yet
+    assert(mem->approxi_mem_usage() > 0);
+    drop->calls ++;
+}
+
+int main() {
+    InternalKeyComparator cmp(bytewise_comparator());
+    // test arenas are charged, and released when their memtables are gone
+    {
+        WriteBufferManager manager(0);
+        MemTableOptions options;
+        options.write_buffer_manager = &manager;
+        MemTable *mem1 = new MemTable(cmp, options);
+        MemTable *mem2 = new MemTable(cmp, options);
+        mem1->ref();
+        mem2->ref();
+        for (int i = 0; i < 1000; i ++) {
+            mem1->add(i + 1, ValType::VALUE, number_key(i), std::string(100, 'x'));
+            mem2->add(i + 1, ValType::VALUE, number_key(i), std::string(10, 'x'));
+        }
+        size_t usage1 = mem1->get_arena_stats().allocated_bytes;
+        size_t usage2 = mem2->get_arena_stats().allocated_bytes;
+        assert(manager.get_memory_usage() >= usage1 + usage2);
+        assert(manager.get_memory_usage() <= mem1->approxi_mem_usage() + mem2->approxi_mem_usage());
+        assert(!manager.should_flush());    // no budget
+        mem1->unref();
+        assert(manager.get_memory_usage() <= mem2->approxi_mem_usage());
+        mem2->unref();
+        assert(manager.get_memory_usage() == 0);
+    }
+    // test the largest candidate is handed back once over budget, and its memory counted as
+    // being freed until it's gone
+    {
+        const size_t budget = 256 * 1024;
+        WriteBufferManager manager(budget);
+        MemTableOptions options;
+        options.write_buffer_manager = &manager;
+        std::vector<MemTable *> flushed;
+        MemTable *small = new MemTable(cmp, options);
+        MemTable *large = new MemTable(cmp, options);
+        small->ref();
+        large->ref();
+        manager.add_flush_candidate(small, record_flush, &flushed);
+        manager.add_flush_candidate(large, record_flush, &flushed);
+
+        int i = 0;
+        while (flushed.empty()) {
+            large->add(i + 1, ValType::VALUE, number_key(i), std::string(100, 'x'));
+            if (i % 10 == 0) small->add(i + 1, ValType::VALUE, number_key(i), std::string(100, 'x'));
+            i ++;
+        }
+        assert(flushed.size() == 1 && flushed[0] == large);
+        assert(manager.get_memory_usage() > budget);
+        assert(manager.get_memory_being_freed() > 0 && !manager.should_flush());
+
+        // the owner switches to a new memtable while the flush runs
+        MemTable *next = new MemTable(cmp, options);
+        next->ref();
+        manager.add_flush_candidate(next, record_flush, &flushed);
+        for (int j = 0; j < 100; j ++) {
+            next->add(i + j + 1, ValType::VALUE, number_key(j), std::string(100, 'x'));
+        }
+        assert(flushed.size() == 1);
+        large->unref();     // flush done
+        assert(manager.get_memory_being_freed() == 0 && !manager.should_flush());
+
+        // a removed memtable is never picked
+        manager.remove_memtable(small);
+        while (flushed.size() == 1) {
+            next->add(i + 1, ValType::VALUE, number_key(i), std::string(100, 'x'));
+            i ++;
+        }
+        assert(flushed.size() == 2 && flushed[1] == next);
+        small->unref();
+        next->unref();
+        assert(manager.get_memory_usage() == 0 && manager.get_memory_being_freed() == 0);
+    }
+    // test the manager holds a ref on a memtable handed back until the owner's call returns
+    {
+        const size_t budget = 64 * 1024;
+        WriteBufferManager manager(budget);
+        MemTableOptions options;
+        options.write_buffer_manager = &manager;
+        MemTable *mem = new MemTable(cmp, options);
+        MemTable *other = new MemTable(cmp, options);
+        mem->ref();
+        other->ref();
+        for (int i = 0; i < 1000; i ++) {
+            mem->add(i + 1, ValType::VALUE, number_key(i), std::string(100, 'x'));
+        }
+        assert(manager.should_flush());
+        DropOwnerRef drop = {&manager, 0};
+        manager.add_flush_candidate(mem, drop_owner_ref, &drop);
+        other->add(1, ValType::VALUE, number_key(0), "x");     // picks mem, which is gone after
+        assert(drop.calls == 1 && manager.get_memory_being_freed() == 0);
+        other->unref();
+        assert(manager.get_memory_usage() == 0);
+    }
+    return 0;
+}